@@ -37,14 +37,36 @@
   pass to that function.  The callback function will be passed two
   arguments: the specified user-defined object, and a binary string to
   write.  Upon failure, the function must return -1, and any other
-  value will indicate success.
+  value will indicate success.  Alternatively, the single value
+  \icon{CURL_SINK_BUFFER} may be given in place of the callback and
+  its object.  In this case the module accumulates the body in an
+  internal buffer, which may be retrieved using \ifun{curl_get_body}.
+  Similarly, \icon{CURL_SINK_FILE} followed by a filename or a
+  \dtype{FD_Type} descriptor, and an optional staging buffer size,
+  causes the body to be written directly to the file by the module.
+  When a filename is given, the data are written to a temporary file
+  in the same directory, which replaces the named file only after the
+  transfer completed successfully.  Space for the file is reserved in
+  advance when the size of the body is known.  For a transfer
+  performed by a \dtype{Curl_Multi_Type} object, the file is put in
+  place when \ifun{curl_multi_info_read} reports the transfer as
+  done.
 \tag{CURLOPT_READFUNCTION} This option requires two parameters: a
   reference to the callback function, and a user-defined object to
   pass to that function.  The callback function will be passed two
   arguments: the specified user-defined object, and the maximum number
   of bytes to be read by the function.  Upon success, the function
   should return a (binary) string, otherwise it should return \NULL to
-  indicate failure.
+  indicate failure.  The string may be longer than the number of bytes
+  requested, in which case the remaining bytes will be used for
+  subsequent reads before the callback is called again.  Returning
+  large strings is an effective way to reduce the number of callbacks.
+\tag{CURLOPT_READDATA} Although the data for the read callback are
+  specified with \icon{CURLOPT_READFUNCTION}, this option may be used
+  in place of a callback to upload the contents of a file, an
+  \dtype{FD_Type} descriptor, or a binary string.  The module reads
+  the data directly, memory-mapping the file where possible, and sets
+  \icon{CURLOPT_INFILESIZE_LARGE} when the size of the data is known.
 \tag{CURLOPT_WRITEHEADER} This option requires two parameters: a
   reference to the callback function, and a user-defined object to
   pass to that function.  The callback function will be passed two
@@ -61,6 +83,114 @@
   return 0 to indicate success, or non-zero to indicate failure.
 \end{descrip}
 
+  The module also implements the following options, which have no
+  counterpart in the \cURL library:
+\begin{descrip}
+\tag{CURLOPT_WRITE_COALESCE} This option takes a number of bytes.  The
+  data passed to the \icon{CURLOPT_WRITEFUNCTION} callback will be
+  accumulated by the module and the callback will be called only when
+  at least that many bytes are available, or when the transfer is
+  complete.  A value of 0, which is the default, causes the callback to
+  be called for each piece of data received, which is copied into a
+  new binary string.  The accumulated data are passed to the callback
+  without being copied again.  Use this option
+  with \icon{CURLOPT_BUFFERSIZE} to further reduce the number of
+  allocations made per megabyte received.
+\tag{CURLOPT_HEADER_COALESCE} This option is like
+  \icon{CURLOPT_WRITE_COALESCE} except that it applies to the
+  \icon{CURLOPT_HEADERFUNCTION} callback.  As a result, the callback
+  may receive several header lines at once.
+\tag{CURLOPT_WRITE_FRAMING} This option causes the module to split
+  the body into records, and to pass an array of the complete records
+  to the \icon{CURLOPT_WRITEFUNCTION} callback in place of the binary
+  string.  Partial records are held back until the rest of the record
+  has been received.  The value of the option specifies how the
+  records are delimited:
+#v+
+    CURL_FRAME_NONE       No framing (default)
+    CURL_FRAME_LINES      Newline delimited records, e.g., NDJSON.
+                          Empty lines are skipped.
+    CURL_FRAME_SSE        Server-Sent Events.  Each record is formed
+                          from the data fields of an event.
+    CURL_FRAME_LENGTH32   Each record is preceded by its length as a
+                          4 byte big-endian integer.  The records are
+                          passed as an array of binary strings.
+#v-
+  The other framings pass an array of strings.  If
+  \icon{CURLOPT_WRITE_COALESCE} is also set, the callback will not be
+  called until at least that many bytes have been received.
+\tag{CURLOPT_WRITE_DIGEST} This option causes a digest of the body to
+  be computed as it is received.  The value of the option specifies
+  the algorithm: \icon{CURL_DIGEST_CRC32C}, \icon{CURL_DIGEST_SHA256},
+  or \icon{CURL_DIGEST_NONE} to turn it off.  The digest is computed
+  regardless of how the body is written, and may be obtained using
+  \ifun{curl_get_digest}.
+\tag{CURLOPT_READ_DIGEST} This option is like
+  \icon{CURLOPT_WRITE_DIGEST}, except that the digest is computed over
+  the data that are uploaded.
+\tag{CURLOPT_QUEUE_PRIORITY} This option takes an integer priority,
+  which defaults to 0.  When the transfers of a
+  \dtype{Curl_Multi_Type} object are limited by
+  \icon{CURLMOPT_MAX_RUNNING}, the queued transfers with the highest
+  priority are started first.  The priority is used when the object is
+  added to the \dtype{Curl_Multi_Type} object.
+\tag{CURLOPT_RETRY_MAX} This option specifies how many times a
+  transfer of a \dtype{Curl_Multi_Type} object is retried if it fails
+  in a way that is likely to be temporary: a connection failure,
+  timeout, send or receive error, empty or partial response, or an
+  HTTP response code of 408, 429, 502, 503, or 504.  The retries are
+  carried out by \ifun{curl_multi_perform} and \ifun{curl_multi_run},
+  and only the outcome of the last attempt is reported by
+  \ifun{curl_multi_info_read}.  Only transfers whose body is written
+  to \icon{CURL_SINK_BUFFER} or \icon{CURL_SINK_FILE} are retried,
+  since these discard the output of a failed attempt.  Transfers that
+  use a \icon{CURLOPT_WRITEFUNCTION}, \icon{CURLOPT_HEADERFUNCTION},
+  or \icon{CURLOPT_READFUNCTION} callback are never retried, because
+  the data already passed to or obtained from the callback cannot be
+  taken back.  The default is 0.
+\tag{CURLOPT_RETRY_BACKOFF} This option takes the delay in seconds
+  before the first retry, and optionally the maximum delay and the
+  factor by which the delay grows with each retry.  The defaults are
+  1, 60, and 2.  If the server sends a \exmp{Retry-After} header, the
+  transfer is retried no sooner than it asks for.  If it asks for more
+  than the maximum delay, the transfer is not retried.
+\tag{CURLOPT_RETRY_JITTER} This option takes a value between 0 and
+  1, which specifies the fraction of each delay that is random, e.g.,
+  a value of 0.5 with a delay of 4 seconds results in a delay of
+  between 2 and 4 seconds.  This keeps many failed transfers from
+  being retried at the same time.  The default is 0.
+\end{descrip}
+
+  The \icon{CURLOPT_POSTFIELDS} option accepts either a string or a
+  binary string.  A binary string may contain arbitrary data, and is
+  passed to the \cURL library without being copied.  In either case,
+  \icon{CURLOPT_POSTFIELDSIZE} or \icon{CURLOPT_POSTFIELDSIZE_LARGE}
+  may be used to post only the first part of the data.
+
+  The \icon{CURLOPT_SHARE} option takes a \var{Curl_Share_Type}
+  object created by \ifun{curl_share_new}, or \NULL to stop sharing.
+
+  The \icon{CURLOPT_MAX_RECV_SPEED_LARGE} and
+  \icon{CURLOPT_MAX_SEND_SPEED_LARGE} options limit the speed of a
+  transfer to the specified number of bytes per second.  See
+  \ifun{curl_multi_setopt} for limits that apply to all of the
+  transfers of a \dtype{Curl_Multi_Type} object.
+
+  The value of the \icon{CURLOPT_HTTP_VERSION} option must be one of
+  \icon{CURL_HTTP_VERSION_NONE}, \icon{CURL_HTTP_VERSION_1_0},
+  \icon{CURL_HTTP_VERSION_1_1}, \icon{CURL_HTTP_VERSION_2},
+  \icon{CURL_HTTP_VERSION_2TLS},
+  \icon{CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE}, or
+  \icon{CURL_HTTP_VERSION_3}.  An exception is thrown if the \cURL
+  library lacks support for the requested version.  The version that
+  was actually used for a transfer may be obtained using
+  \ifun{curl_get_info} with \icon{CURLINFO_HTTP_VERSION}.
+
+  The \icon{CURLOPT_MIMEPOST} option (also available as
+  \icon{CURLOPT_HTTPPOST}) takes a \var{Curl_Mime_Type} object created
+  by \ifun{curl_mime_new} for the same \var{Curl_Type} object.  Use
+  \NULL to remove it.
+
   A number of the options in the \cURL API take a linked list of
   strings.  Instead of a linked list, the module requires an array of
   strings for such options, e.g.,
@@ -108,6 +238,11 @@
        curl_perform (c);
        () = fprintf (stdout, "Header: %s\n", var);
     }
+#v-
+  The download_url function could have been written without the write
+  callback:
+#v+
+       curl_setopt (c, CURLOPT_WRITEFUNCTION, CURL_SINK_FILE, file, 1024*1024);
 #v-
 \seealso{curl_new, curl_perform, curl_multi_new}
 \done
@@ -173,6 +308,130 @@
 \seealso{curl_new}
 \done
 
+\function{curl_perform_async}
+\synopsis{Perform a transfer in the background}
+\usage{curl_perform_async (Curl_Type c)}
+\description
+  This function is like \ifun{curl_perform}, except that the transfer
+  is carried out by a separate thread, and the function returns
+  immediately.  The transfers are distributed over a number of
+  threads, each of which drives a multi handle; see
+  \ifun{curl_async_init}.  Unless a \dtype{Curl_Share_Type} object has
+  been attached to the handle, the DNS cache and TLS sessions are
+  shared by all of the threads.  Since the threads cannot execute
+  S-Lang code, the body
+  must be written to \icon{CURL_SINK_BUFFER} or \icon{CURL_SINK_FILE},
+  and no other callbacks may be used.  Until the transfer has been
+  collected using \ifun{curl_async_poll} or \ifun{curl_async_wait},
+  the \dtype{Curl_Type} object may not be used.  The transfer is
+  performed with \icon{CURLOPT_NOSIGNAL} enabled; the previous value
+  of that option, and the absence of a share, are restored when the
+  transfer is collected.
+\example
+#v+
+    foreach url (urls)
+      {
+         c = curl_new (url);
+         curl_setopt (c, CURLOPT_WRITEFUNCTION, CURL_SINK_BUFFER);
+         curl_perform_async (c);
+      }
+    loop (length (urls))
+      {
+         (handles, status) = curl_async_wait ();
+         _for i (0, length (handles)-1, 1)
+           process (handles[i], status[i]);
+      }
+#v-
+\notes
+  This function requires POSIX threads and libcurl 7.68.0 or newer.
+\seealso{curl_async_init, curl_async_poll, curl_async_wait, curl_perform}
+\done
+
+\function{curl_async_init}
+\synopsis{Set the number of threads used for background transfers}
+\usage{curl_async_init ([Int_Type num_threads])}
+\description
+  This function starts the threads that carry out the transfers of
+  \ifun{curl_perform_async}.  Each thread drives its own multi handle,
+  and transfers are submitted to the least busy thread.  A thread that
+  has run out of work takes over transfers that are still waiting to be
+  started by another.  If the number of threads is not given, one
+  thread per processor is used, which is also the default if
+  \ifun{curl_perform_async} is called first.  This function may be
+  called only once.
+\seealso{curl_perform_async}
+\done
+
+\function{curl_async_poll}
+\synopsis{Collect the completed background transfers}
+\usage{(handles, status) = curl_async_poll ()}
+\description
+  This function returns an array of the \dtype{Curl_Type} objects whose
+  transfers, started by \ifun{curl_perform_async}, have completed
+  since the last call, and an array of their completion status codes.
+  The arrays are empty if no transfer has completed.  This function
+  does not wait.
+\seealso{curl_async_wait, curl_perform_async}
+\done
+
+\function{curl_async_wait}
+\synopsis{Wait for background transfers to complete}
+\usage{(handles, status) = curl_async_wait ([Double_Type timeout])}
+\description
+  This function is like \ifun{curl_async_poll}, except that it waits up
+  to \exmp{timeout} seconds for at least one transfer to complete.
+  Without a timeout, it waits as long as transfers are outstanding.
+\seealso{curl_async_poll, curl_perform_async}
+\done
+
+\function{curl_reset}
+\synopsis{Reset the options of a Curl_Type object}
+\usage{curl_reset (Curl_Type c [,String_Type url])}
+\description
+  This function is a wrapper around the \curlapi{curl_easy_reset}
+  \cURL library function.  All of the options that were set using
+  \ifun{curl_setopt}, including the callbacks, are returned to their
+  default values.  The URL of the object is retained unless a new one
+  is given by the optional \exmp{url} argument.  Unlike a new
+  \dtype{Curl_Type} object, a reset one keeps its open connections,
+  and its DNS and TLS session caches.
+\seealso{curl_new, curl_pool_get, curl_setopt}
+\done
+
+\function{curl_pool_get}
+\synopsis{Get a Curl_Type object from the pool of idle objects}
+\usage{Curl_Type curl_pool_get (String_Type url)}
+\description
+  This function returns a \dtype{Curl_Type} object for the specified
+  URL.  If the pool contains a \dtype{Curl_Type} object that was
+  returned to it by \ifun{curl_pool_put}, that object will be used,
+  which permits any open connections that it has to be reused.
+  Otherwise a new object is created as if by \ifun{curl_new}.
+\example
+#v+
+    c = curl_pool_get (url);
+    curl_setopt (c, CURLOPT_WRITEFUNCTION, CURL_SINK_BUFFER);
+    curl_perform (c);
+    body = curl_get_body (c);
+    curl_pool_put (c);
+#v-
+\seealso{curl_pool_put, curl_reset, curl_new}
+\done
+
+\function{curl_pool_put}
+\synopsis{Return a Curl_Type object to the pool of idle objects}
+\usage{curl_pool_put (Curl_Type c)}
+\description
+  This function resets the specified \dtype{Curl_Type} object as if by
+  \ifun{curl_reset}, and places it in the pool of idle objects used by
+  \ifun{curl_pool_get}.  The object is closed by this function, and
+  may not be used after it has been called, even through other
+  variables that refer to it: \ifun{curl_pool_get} always returns a
+  new object.  If the pool is full, the underlying handle is simply
+  released.
+\seealso{curl_pool_get, curl_reset}
+\done
+
 \function{curl_easy_strerror}
 \synopsis{Get the string representation for a curl error code}
 \usage{String_Type curl_easy_strerror (errcode)}
@@ -212,7 +471,18 @@
   takes an additional argument (\exmp{dt}) that causes the function to
   wait up to that many seconds for one of the underlying
   \dtype{Curl_Type} objects to become ready for reading or writing.
-  The function returns the number of \dtype{Curl_Type}.
+  The wait will be shorter if the \cURL library needs to be called
+  sooner, e.g., to handle a timeout, or if \ifun{curl_multi_wakeup} is
+  called.  The function returns the number of \dtype{Curl_Type}
+  objects whose transfers have not yet completed.  Besides the running
+  transfers, this includes those queued because of
+  \icon{CURLMOPT_MAX_RUNNING}, those waiting to be retried because of
+  \icon{CURLOPT_RETRY_MAX}, and those held back by one of the
+  \icon{CURLMOPT_MAX_*_RATE} limits.  Queued transfers are started as
+  the running ones complete, and the others once their delay has
+  elapsed.  Hence a loop that calls this function while it returns a
+  positive value keeps going during such delays, even though no
+  transfer is running.
 \seealso{curl_multi_new, curl_multi_length, curl_multi_add_handle}
 \done
 
@@ -267,6 +537,8 @@
   the individual transfer failed and the completion status gives the
   error code associated with the transfer.  More infomation about the
   transfer may be obtained by calling the \ifun{curl_get_info} function.
+  A transfer that will be retried because of \icon{CURLOPT_RETRY_MAX}
+  is not reported.
 \example
   The \ifun{curl_multi_info_read} function should be called after a
   call to \ifun{curl_multi_perform} has indicated that a transfer has
@@ -289,6 +561,149 @@
 \seealso{curl_multi_perform, curl_multi_remove_handle, curl_get_info}
 \done
 
+\function{curl_multi_setopt}
+\synopsis{Set an option for a Curl_Multi_Type object}
+\usage{curl_multi_setopt (Curl_Multi_Type m, Int_Type option, value)}
+\description
+  This function is a wrapper around the \curlapi{curl_multi_setopt}
+  \cURL library function.  The following options are supported:
+#v+
+    CURLMOPT_MAX_TOTAL_CONNECTIONS
+    CURLMOPT_MAX_HOST_CONNECTIONS
+    CURLMOPT_MAXCONNECTS
+    CURLMOPT_PIPELINING
+    CURLMOPT_MAX_CONCURRENT_STREAMS
+#v-
+  When one of the connection limits has been reached, the \cURL library
+  queues the transfers of additional \dtype{Curl_Type} objects until a
+  connection becomes available.  The value of the
+  \icon{CURLMOPT_PIPELINING} option is one of \icon{CURLPIPE_NOTHING},
+  \icon{CURLPIPE_HTTP1}, or \icon{CURLPIPE_MULTIPLEX}, the latter of
+  which permits transfers to share an HTTP/2 connection.
+
+  The following options are implemented by the module itself:
+\begin{descrip}
+\tag{CURLMOPT_MAX_RUNNING} This option limits the number of transfers
+  that are handed to the \cURL library at the same time.  The
+  \dtype{Curl_Type} objects that are added beyond this limit are
+  queued by the module and started as running transfers complete, in
+  the order of their \icon{CURLOPT_QUEUE_PRIORITY}.  Transfers of the
+  same priority are started in proportion to the weights of their
+  hosts using weighted fair queueing.  The default of 0 means no
+  limit.
+\tag{CURLMOPT_HOST_WEIGHT} This option takes two values: a host name
+  and a positive weight, which defaults to 1.  A host with a weight of
+  2 will have twice as many of its queued transfers started as a host
+  with a weight of 1.
+\tag{CURLMOPT_MAX_REQUEST_RATE} This option limits the rate at which
+  transfers are started to the specified number per second.  An
+  optional second value specifies the size of a burst of transfers
+  that may be started at once after a period of inactivity, which
+  defaults to one second's worth.  Transfers beyond the limit remain
+  queued until \ifun{curl_multi_perform} or \ifun{curl_multi_run}
+  finds that they may start; these functions wait no longer than
+  that.  A rate of 0, the default, means no limit.
+\tag{CURLMOPT_MAX_BYTE_RATE} This option is like
+  \icon{CURLMOPT_MAX_REQUEST_RATE}, except that the limit is in bytes
+  per second.  The bytes of each transfer, including the headers, are
+  counted when it completes, and no further transfers are started
+  until the limit permits.  Since this does not slow down the running
+  transfers, \icon{CURLOPT_MAX_RECV_SPEED_LARGE} should be used for
+  large ones.
+\tag{CURLMOPT_MAX_HOST_REQUEST_RATE} This option is like
+  \icon{CURLMOPT_MAX_REQUEST_RATE}, except that it applies to the
+  transfers to each host separately.  If the first value is a host
+  name, the limit applies only to that host, and a negative rate
+  reverts it to the limit for all hosts.  The transfers to a host
+  that has reached its limit do not delay those to other hosts.
+\tag{CURLMOPT_MAX_HOST_BYTE_RATE} This option is the per-host
+  counterpart of \icon{CURLMOPT_MAX_BYTE_RATE}, and takes the same
+  values as \icon{CURLMOPT_MAX_HOST_REQUEST_RATE}.
+\end{descrip}
+\example
+#v+
+    m = curl_multi_new ();
+    curl_multi_setopt (m, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt (m, CURLMOPT_MAX_HOST_CONNECTIONS, 4);
+    curl_multi_setopt (m, CURLMOPT_MAX_RUNNING, 32);
+    curl_multi_setopt (m, CURLMOPT_HOST_WEIGHT, "api.example.com", 4.0);
+    curl_multi_setopt (m, CURLMOPT_MAX_HOST_REQUEST_RATE, 2.0);
+    curl_multi_setopt (m, CURLMOPT_MAX_HOST_REQUEST_RATE, "api.example.com", 10.0);
+    curl_setopt (c, CURLOPT_QUEUE_PRIORITY, 10);
+    curl_multi_add_handle (m, c);
+#v-
+\seealso{curl_multi_new, curl_setopt}
+\done
+
+\function{curl_multi_info_read_all}
+\synopsis{Get information about all completed Curl_Multi_Type transfers}
+\usage{(handles, status, codes, times) = curl_multi_info_read_all (Curl_Multi_Type m)}
+\description
+  This function is like \ifun{curl_multi_info_read}, except that it
+  retrieves all of the completed transfers at once.  It returns four
+  arrays of the same length: the completed \dtype{Curl_Type} objects,
+  their completion status codes, their response codes, and their total
+  transfer times in seconds.  The arrays will be empty if no transfer
+  has completed.
+\example
+#v+
+    (handles, status, codes, times) = curl_multi_info_read_all (m);
+    _for i (0, length (handles)-1, 1)
+      {
+         curl_multi_remove_handle (m, handles[i]);
+         if ((status[i] == 0) && (codes[i] == 200))
+           vmessage ("Retrieved %s in %g seconds",
+                     curl_get_url (handles[i]), times[i]);
+      }
+#v-
+\seealso{curl_multi_info_read, curl_multi_perform, curl_multi_run}
+\done
+
+\function{curl_multi_run}
+\synopsis{Process a Curl_Multi_Type object using socket events}
+\usage{Int_Type curl_multi_run (Curl_Multi_Type m [,Double_Type dt])}
+\description
+  This function is an alternative to \ifun{curl_multi_perform} that is
+  better suited to a large number of mostly idle transfers.  It waits
+  up to \exmp{dt} seconds for activity on the sockets used by the
+  transfers, and only those sockets that are ready are processed.  The
+  function returns when one or more transfers have completed, when
+  \exmp{dt} seconds have elapsed, when \ifun{curl_multi_wakeup} has
+  been called, or when there are no more running transfers.  Like
+  \ifun{curl_multi_perform}, it returns the number of transfers that
+  have not yet completed, including the queued, retrying and held
+  ones, and \ifun{curl_multi_info_read} should be used to find out
+  which ones have completed.
+\example
+#v+
+    while (curl_multi_run (m, 5.0) > 0)
+      {
+         while (c = curl_multi_info_read (m, &status), c != NULL)
+           process_transfer (m, c, status);
+      }
+#v-
+\notes
+  This function uses \exmp{epoll}, and on systems without it falls
+  back to \ifun{curl_multi_perform}.
+\seealso{curl_multi_perform, curl_multi_info_read, curl_multi_wakeup}
+\done
+
+\function{curl_multi_wakeup}
+\synopsis{Interrupt a wait in curl_multi_perform}
+\usage{curl_multi_wakeup (Curl_Multi_Type m)}
+\description
+  This function is a wrapper around the \curlapi{curl_multi_wakeup}
+  \cURL library function.  It causes the wait for activity on
+  \exmp{m} that \ifun{curl_multi_perform} or \ifun{curl_multi_run}
+  is performing, or will perform next, to return as soon as possible.
+  Since S-Lang code does not run while the interpreter is waiting,
+  this is mainly useful from a callback that has made more work
+  available.
+\notes
+  This function requires version 7.68.0 or newer of the \cURL library.
+\seealso{curl_multi_perform, curl_multi_run}
+\done
+
 \function{curl_get_url}
 \synopsis{Get the URL associated with a Curl_Type object}
 \usage{String_Type curl_get_url (Curl_Type c)}
@@ -298,6 +713,203 @@
 \seealso{curl_new, curl_get_info}
 \done
 
+\function{curl_get_body}
+\synopsis{Get the body accumulated by a Curl_Type object}
+\usage{BString_Type curl_get_body (Curl_Type c)}
+\description
+  This function returns the data that has been received by a
+  \dtype{Curl_Type} object whose \icon{CURLOPT_WRITEFUNCTION} option
+  has been set to \icon{CURL_SINK_BUFFER}.  The data are accumulated
+  by the module without calling into the interpreter, and when the
+  size of the body is known in advance, the buffer is allocated only
+  once.  The internal buffer is emptied by this function.
+\example
+#v+
+    c = curl_new (url);
+    curl_setopt (c, CURLOPT_WRITEFUNCTION, CURL_SINK_BUFFER);
+    curl_perform (c);
+    body = curl_get_body (c);
+#v-
+\seealso{curl_setopt, curl_perform}
+\done
+
+\function{curl_get_header}
+\synopsis{Get the value of a response header}
+\usage{String_Type curl_get_header (Curl_Type c, String_Type name)}
+\description
+  This function returns the value of the named header from the most
+  recent response received by the \dtype{Curl_Type} object.  The name
+  is not case-sensitive.  If the header occurs more than once, the
+  values are combined into a single comma separated string.  If the
+  response did not include the header, \NULL will be returned.  When a
+  redirect is followed, only the headers of the final response are
+  considered.
+
+  Unlike \icon{CURLOPT_HEADERFUNCTION}, this function does not require
+  any interaction with the interpreter during the transfer.
+\notes
+  This function requires version 7.83.0 or newer of the \cURL library.
+\seealso{curl_get_headers, curl_get_info, curl_setopt}
+\done
+
+\function{curl_get_headers}
+\synopsis{Get the response headers}
+\usage{Assoc_Type curl_get_headers (Curl_Type c)}
+\description
+  This function returns the headers of the most recent response
+  received by the \dtype{Curl_Type} object as an associative array.
+  The keys of the array are the lowercased header names, and the
+  values are formed as described for \ifun{curl_get_header}.
+\example
+#v+
+    headers = curl_get_headers (c);
+    if (assoc_key_exists (headers, "content-type"))
+      type = headers["content-type"];
+#v-
+\notes
+  This function requires version 7.83.0 or newer of the \cURL library.
+\seealso{curl_get_header, curl_get_info}
+\done
+
+\function{curl_get_digest}
+\synopsis{Get the digest of the data transferred by a Curl_Type object}
+\usage{String_Type curl_get_digest (Curl_Type c [,Int_Type which])}
+\description
+  This function returns the digest of the data transferred so far as
+  a hexadecimal string.  By default, the digest of the data received is
+  returned.  If \exmp{which} is \icon{CURLOPT_READ_DIGEST}, the digest
+  of the uploaded data will be returned.  If no digest was requested
+  using \ifun{curl_setopt}, \NULL will be returned.  The digest is
+  reset at the start of each transfer.
+\example
+#v+
+    c = curl_new (url);
+    curl_setopt (c, CURLOPT_WRITEFUNCTION, CURL_SINK_FILE, file);
+    curl_setopt (c, CURLOPT_WRITE_DIGEST, CURL_DIGEST_SHA256);
+    curl_perform (c);
+    if (curl_get_digest (c) != expected_sha256)
+      throw DataError, "$file is corrupt"$;
+#v-
+\seealso{curl_setopt, curl_get_info}
+\done
+
+\function{curl_fetch_many}
+\synopsis{Retrieve a number of URLs concurrently}
+\usage{(bodies, status, codes, times) = curl_fetch_many (String_Type urls[])}
+\description
+  This function retrieves the specified URLs concurrently, and
+  returns four arrays that are indexed like \exmp{urls}: the bodies of
+  the responses as binary strings, the completion status codes of the
+  transfers, the response codes, and the total transfer times in
+  seconds.  The body of a failed transfer is \NULL.  The transfers
+  are carried out entirely by the module, without the overhead of
+  \ifun{curl_multi_perform} and \ifun{curl_multi_info_read}.
+
+  The following qualifiers are supported:
+#v+
+    parallel=16          Maximum number of transfers in progress
+    timeout=0            Per transfer timeout in seconds (0 for none)
+    connect_timeout=0    Connection timeout in seconds (0 for default)
+    follow=0             If non-zero, follow redirects
+    useragent=NULL       The User-Agent header to use
+#v-
+\example
+#v+
+    (bodies, status, codes, times)
+       = curl_fetch_many (urls; parallel=64, timeout=10);
+    i = where ((status == 0) and (codes == 200));
+#v-
+\seealso{curl_multi_new, curl_multi_info_read_all}
+\done
+
+\function{curl_share_new}
+\synopsis{Create an object for sharing data between Curl_Type objects}
+\usage{Curl_Share_Type curl_share_new ([Int_Type lock_data, ...])}
+\description
+  This function is a wrapper around the \curlapi{curl_share_init}
+  \cURL library function.  The object that it returns may be used with
+  the \icon{CURLOPT_SHARE} option to allow a number of \var{Curl_Type}
+  objects to share data such as resolved host names, TLS sessions, and
+  open connections.  The kinds of data to be shared may be specified
+  as arguments to the function, or later using \ifun{curl_share_setopt}:
+#v+
+    CURL_LOCK_DATA_DNS           Resolved host names
+    CURL_LOCK_DATA_SSL_SESSION   TLS session identifiers
+    CURL_LOCK_DATA_CONNECT       The connection cache
+    CURL_LOCK_DATA_COOKIE        Cookies
+#v-
+\example
+#v+
+    s = curl_share_new (CURL_LOCK_DATA_DNS, CURL_LOCK_DATA_SSL_SESSION,
+                        CURL_LOCK_DATA_CONNECT);
+    foreach url (urls)
+      {
+         c = curl_new (url);
+         curl_setopt (c, CURLOPT_SHARE, s);
+         curl_perform (c);
+      }
+#v-
+\seealso{curl_share_setopt, curl_setopt}
+\done
+
+\function{curl_share_setopt}
+\synopsis{Set an option for a Curl_Share_Type object}
+\usage{curl_share_setopt (Curl_Share_Type s, Int_Type option, Int_Type lock_data)}
+\description
+  This function is a wrapper around the \curlapi{curl_share_setopt}
+  \cURL library function.  The \exmp{option} argument must be either
+  \icon{CURLSHOPT_SHARE} or \icon{CURLSHOPT_UNSHARE}, and
+  \exmp{lock_data} one of the \icon{CURL_LOCK_DATA_*} constants
+  described in the documentation for \ifun{curl_share_new}.
+\seealso{curl_share_new}
+\done
+
+\function{curl_mime_new}
+\synopsis{Create a multipart/form-data object}
+\usage{Curl_Mime_Type curl_mime_new (Curl_Type c)}
+\description
+  This function returns a new \var{Curl_Mime_Type} object that may be
+  used with the \icon{CURLOPT_MIMEPOST} option of the \var{Curl_Type}
+  object \exmp{c}.  Parts may be added to it using
+  \ifun{curl_mime_addpart} and \ifun{curl_mime_addfile}.
+\example
+#v+
+    c = curl_new (url);
+    m = curl_mime_new (c);
+    curl_mime_addpart (m, "description", "Holiday pictures");
+    curl_mime_addfile (m, "photo", "/tmp/img0001.jpg", "image/jpeg");
+    curl_setopt (c, CURLOPT_MIMEPOST, m);
+    curl_perform (c);
+#v-
+\notes
+  This function requires version 7.56.0 or newer of the \cURL library.
+\seealso{curl_mime_addpart, curl_mime_addfile, curl_setopt}
+\done
+
+\function{curl_mime_addpart}
+\synopsis{Add a part to a multipart/form-data object}
+\usage{curl_mime_addpart (Curl_Mime_Type m, String_Type name, data [,type [,filename]])}
+\description
+  This function adds a part called \exmp{name} to \exmp{m}, whose
+  contents are given by the string or binary string \exmp{data}.  The
+  optional \exmp{type} argument specifies the content-type of the
+  part, and \exmp{filename} the remote file name.
+\seealso{curl_mime_new, curl_mime_addfile}
+\done
+
+\function{curl_mime_addfile}
+\synopsis{Add a file part to a multipart/form-data object}
+\usage{curl_mime_addfile (Curl_Mime_Type m, String_Type name, String_Type path [,type [,filename]])}
+\description
+  This function adds a part called \exmp{name} to \exmp{m} whose
+  contents are those of the file \exmp{path}.  The file is not read
+  by this function; rather it is read by the \cURL library as the
+  data are uploaded.  The remote file name defaults to the basename of
+  \exmp{path}, and may be changed using the \exmp{filename} argument.
+  The optional \exmp{type} argument specifies the content-type.
+\seealso{curl_mime_new, curl_mime_addpart}
+\done
+
 \function{curl_multi_length}
 \synopsis{Get the number of Curl_Type objects in a Curl_Multi_Type}
 \usage{Int_Type curl_multi_length (Curl_Multi_Type m)}
@@ -21,8 +21,34 @@ USA.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#if defined(__linux__)
+# define HAVE_EPOLL
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+#endif
+#if defined(_POSIX_MAPPED_FILES) && (_POSIX_MAPPED_FILES > 0)
+# define HAVE_MMAP
+# include <sys/mman.h>
+#endif
+#if defined(__SSE4_2__)
+# include <nmmintrin.h>
+#endif
+#if defined(_POSIX_THREADS) && (_POSIX_THREADS > 0) && defined(__GNUC__)
+# define HAVE_PTHREADS
+# include <pthread.h>
+# include <poll.h>
+#endif
 #include <slang.h>
 
 #include <curl/curl.h>
@@ -50,6 +76,34 @@ SLANG_MODULE(curl);
 # define HAVE_CURLOPT_EGDSOCKET
 #endif
 
+#if CURL_VERSION_GE(7,83,0)
+# define HAVE_CURL_EASY_HEADER
+#endif
+
+#if CURL_VERSION_GE(7,68,0)
+# define HAVE_CURL_MULTI_WAKEUP
+#endif
+
+#if CURL_VERSION_GE(7,67,0)
+# define HAVE_CURLMOPT_MAX_CONCURRENT_STREAMS
+#endif
+
+/* curl_perform_async uses threads driving multi handles that are woken up
+ * using curl_multi_wakeup.
+ */
+#if defined(HAVE_PTHREADS) && defined(HAVE_CURL_MULTI_WAKEUP)
+# define HAVE_ASYNC
+#endif
+
+#if CURL_VERSION_GE(7,66,0)
+# define HAVE_CURL_MULTI_POLL
+# define HAVE_CURLINFO_RETRY_AFTER
+#endif
+
+#if CURL_VERSION_GE(7,28,0)
+# define HAVE_CURL_MULTI_WAIT
+#endif
+
 #if CURL_VERSION_GE(7,56,0)
 # define HAVE_CURLOPT_MIMEPOST
 # define CURLOPT_HTTPPOST CURLOPT_MIMEPOST
@@ -70,11 +124,41 @@ SLANG_MODULE(curl);
 # define CURLINFO_CONTENT_LENGTH_DOWNLOAD CURLINFO_CONTENT_LENGTH_DOWNLOAD_T
 #endif
 
+#if CURL_VERSION_GE(7,66,0)
+# define HAVE_CURL_HTTP_VERSION_3
+#endif
+
+#if CURL_VERSION_GE(7,50,0)
+# define HAVE_CURLINFO_HTTP_VERSION
+#endif
+
+#if CURL_VERSION_GE(7,49,0)
+# define HAVE_CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+# define HAVE_CURLE_HTTP2_STREAM
+#endif
+
+#if CURL_VERSION_GE(7,47,0)
+# define HAVE_CURL_HTTP_VERSION_2TLS
+#endif
+
+#if CURL_VERSION_GE(7,43,0)
+# define HAVE_CURLPIPE_MULTIPLEX
+#endif
+
+#if CURL_VERSION_GE(7,33,0)
+# define HAVE_CURL_HTTP_VERSION_2_0
+#endif
+
 #if CURL_VERSION_GE(7,32,0)
 # define HAVE_CURLOPT_XFERINFOFUNCTION
 # define CURLOPT_PROGRESSFUNCTION CURLOPT_XFERINFOFUNCTION
 #endif
 
+#if CURL_VERSION_GE(7,30,0)
+# define HAVE_CURLMOPT_MAX_TOTAL_CONNECTIONS
+# define HAVE_CURLMOPT_MAX_HOST_CONNECTIONS
+#endif
+
 #if CURL_VERSION_GE(7,21,6)
 # define HAVE_CURLOPT_ACCEPT_ENCODING
 #endif
@@ -90,6 +174,14 @@ SLANG_MODULE(curl);
 # define HAVE_CURLOPT_USE_SSL
 #endif
 
+#if CURL_VERSION_GE(7,16,3)
+# define HAVE_CURLMOPT_MAXCONNECTS
+#endif
+
+#if CURL_VERSION_GE(7,16,0)
+# define HAVE_CURLMOPT_PIPELINING
+#endif
+
 #if CURL_VERSION_LT(7,16,0)
 # define HAVE_CURLOPT_PREQUOTE
 # define HAVE_CURLOPT_SOURCE_PREQUOTE
@@ -114,6 +206,10 @@ SLANG_MODULE(curl);
 # define CURLOPT_PUT CURLOPT_UPLOAD
 #endif
 
+#if CURL_VERSION_GE(7,57,0)
+# define HAVE_CURL_LOCK_DATA_CONNECT
+#endif
+
 #if CURL_VERSION_GE(7,11,1)
 # define HAVE_CURLOPT_SHARE
 # define CURLOPT_DNS_USE_GLOBAL_CACHE CURLOPT_SHARE
@@ -122,6 +218,137 @@ SLANG_MODULE(curl);
 static int Curl_Error = 0;
 static SLtype Easy_Type_Id = 0;
 static SLtype Multi_Type_Id = 0;
+#ifdef HAVE_CURLOPT_MIMEPOST
+static SLtype Mime_Type_Id = 0;
+#endif
+#ifdef HAVE_CURLOPT_SHARE
+static SLtype Share_Type_Id = 0;
+#endif
+
+/* A simple growable byte buffer used by the native sinks.  A buffer that
+ * is filled by a worker thread uses malloc, since the S-Lang allocator
+ * sets the error state of the interpreter when it fails.
+ */
+typedef struct
+{
+   unsigned char *data;		       /* SLmalloced, or malloced if native */
+   size_t len;
+   size_t max;
+   int native;
+}
+Byte_Buffer_Type;
+
+/* Values that may be passed in place of a callback function to
+ * CURLOPT_WRITEFUNCTION.
+ */
+#define CURL_SINK_CALLBACK	0
+#define CURL_SINK_BUFFER	1
+#define CURL_SINK_FILE		2
+
+/* The source of the data to upload if CURLOPT_READDATA was given a file,
+ * descriptor, or binary string rather than using a read callback.
+ */
+#define READ_SOURCE_NONE	0
+#define READ_SOURCE_MEMORY	1      /* bstring or mmapped file */
+#define READ_SOURCE_FD		2      /* read with pread, or read if not seekable */
+typedef struct
+{
+   int type;			       /* READ_SOURCE_* */
+   SLang_BString_Type *bstr;
+   unsigned char *map;		       /* if non-NULL, mmapped region of map_len bytes */
+   size_t map_len;
+   unsigned char *data;		       /* READ_SOURCE_MEMORY */
+   int fd;			       /* READ_SOURCE_FD, or -1 */
+   int seekable;
+   curl_off_t start;		       /* offset of the first byte */
+   curl_off_t size;		       /* bytes to upload, or -1 if unknown */
+   curl_off_t offset;		       /* bytes uploaded so far */
+}
+Read_Source_Type;
+
+/* Options implemented by the module rather than by libcurl.  These are
+ * handled by curl_setopt but never passed to curl_easy_setopt.
+ */
+#define MODULE_OPT_BASE		0x10000
+#define CURLOPT_WRITE_COALESCE	(MODULE_OPT_BASE + 1)
+#define CURLOPT_HEADER_COALESCE	(MODULE_OPT_BASE + 2)
+#define CURLOPT_WRITE_FRAMING	(MODULE_OPT_BASE + 3)
+#define CURLOPT_WRITE_DIGEST	(MODULE_OPT_BASE + 4)
+#define CURLOPT_READ_DIGEST	(MODULE_OPT_BASE + 5)
+#define CURLOPT_QUEUE_PRIORITY	(MODULE_OPT_BASE + 6)
+#define CURLOPT_RETRY_MAX	(MODULE_OPT_BASE + 7)
+#define CURLOPT_RETRY_BACKOFF	(MODULE_OPT_BASE + 8)
+#define CURLOPT_RETRY_JITTER	(MODULE_OPT_BASE + 9)
+
+/* Defaults for CURLOPT_RETRY_BACKOFF */
+#define RETRY_DELAY		1.0
+#define RETRY_MAX_DELAY		60.0
+#define RETRY_FACTOR		2.0
+
+/* Options for Curl_Multi_Type objects that are implemented by the module */
+#define CURLMOPT_MAX_RUNNING	(MODULE_OPT_BASE + 1)
+#define CURLMOPT_HOST_WEIGHT	(MODULE_OPT_BASE + 2)
+#define CURLMOPT_MAX_REQUEST_RATE	(MODULE_OPT_BASE + 3)
+#define CURLMOPT_MAX_BYTE_RATE		(MODULE_OPT_BASE + 4)
+#define CURLMOPT_MAX_HOST_REQUEST_RATE	(MODULE_OPT_BASE + 5)
+#define CURLMOPT_MAX_HOST_BYTE_RATE	(MODULE_OPT_BASE + 6)
+
+/* Values for CURLOPT_WRITE_DIGEST and CURLOPT_READ_DIGEST */
+#define CURL_DIGEST_NONE	0
+#define CURL_DIGEST_CRC32C	1
+#define CURL_DIGEST_SHA256	2
+
+/* A digest that is computed as the data are transferred */
+typedef struct
+{
+   int type;			       /* CURL_DIGEST_* */
+   uint32_t crc;
+   uint32_t state[8];		       /* SHA-256 */
+   uint64_t count;		       /* SHA-256: bytes processed */
+   unsigned char block[64];	       /* SHA-256: partial block */
+}
+Digest_Type;
+
+/* Values for CURLOPT_WRITE_FRAMING */
+#define CURL_FRAME_NONE		0
+#define CURL_FRAME_LINES	1      /* newline delimited, e.g., NDJSON */
+#define CURL_FRAME_SSE		2      /* data of Server-Sent Events */
+#define CURL_FRAME_LENGTH32	3      /* 4 byte big-endian length prefix */
+
+/* The framer splits the body into records that are passed to the write
+ * callback as an array.
+ */
+typedef struct
+{
+   int type;			       /* CURL_FRAME_* */
+   Byte_Buffer_Type buf;	       /* bytes of an incomplete record */
+   Byte_Buffer_Type event;	       /* CURL_FRAME_SSE: data of the current event */
+   int have_event;
+   VOID_STAR *records;		       /* slstrings, or bstrings for LENGTH32 */
+   SLindex_Type num_records;
+   SLindex_Type max_records;
+}
+Framer_Type;
+
+/* State for CURL_SINK_FILE.  If a path was given, the body is written to
+ * a temporary file in the same directory that gets renamed to the path
+ * when the transfer completes.  Otherwise the body is written to a
+ * duplicate of the descriptor supplied by the caller.
+ */
+typedef struct
+{
+   char *path;			       /* slstring, or NULL if using a descriptor */
+   char *tmp_path;		       /* SLmalloced */
+   int user_fd;			       /* dup of the caller's descriptor, or -1 */
+   int fd;			       /* descriptor of the current transfer */
+   int seekable;
+   curl_off_t offset;
+   curl_off_t start_offset;
+   curl_off_t reserved_from;	       /* size before a reservation, or -1 */
+   size_t stage_size;		       /* 0 if writes are not staged */
+   Byte_Buffer_Type stage;
+}
+File_Sink_Type;
 
 typedef struct Easy_Type
 {
@@ -130,18 +357,43 @@ typedef struct Easy_Type
    SLang_MMT_Type *mmt;		       /* parent MMT */
    unsigned int flags;
 #define PERFORM_RUNNING	0x1
+#define ASYNC_RUNNING	0x4
+#define MULTI_DONE	0x8	       /* on the list of completed transfers of the multi */
+#define MULTI_RETRY	0x10	       /* waiting to be retried by the multi */
+#define MULTI_HELD	0x20	       /* held back by the rate limits of its host */
 
    char errbuf [CURL_ERROR_SIZE+1];
 
    SLang_Name_Type *write_callback;    /* int write(write_data, bytes) */
    SLang_Any_Type *write_data;
+   int write_sink;		       /* CURL_SINK_* */
+   Byte_Buffer_Type body;	       /* For CURL_SINK_BUFFER */
+   File_Sink_Type file_sink;	       /* For CURL_SINK_FILE */
 
    SLang_Name_Type *read_callback;
    SLang_Any_Type *read_data;
+   Read_Source_Type read_source;       /* For CURLOPT_READDATA */
+   /* If the read callback returns more than was asked for, the string is
+    * kept here and the rest is used for the next reads.
+    */
+   SLang_BString_Type *read_pending;
+   SLstrlen_Type read_pending_offset;
 
    SLang_Name_Type *writeheader_callback;
    SLang_Any_Type *writeheader_data;
 
+   /* Data for the write and header callbacks are held back until at least
+    * this many bytes are available.  0 means no coalescing.
+    */
+   size_t write_coalesce;
+   Byte_Buffer_Type write_pending;
+   size_t header_coalesce;
+   Byte_Buffer_Type header_pending;
+
+   Framer_Type framer;		       /* For CURLOPT_WRITE_FRAMING */
+   Digest_Type write_digest;	       /* For CURLOPT_WRITE_DIGEST */
+   Digest_Type read_digest;	       /* For CURLOPT_READ_DIGEST */
+
    SLang_Name_Type *progress_callback;
    SLang_Any_Type *progress_data;
 
@@ -160,1445 +412,6552 @@ typedef struct Easy_Type
    struct curl_slist *source_prequote;
    struct curl_slist *source_postquote;
    struct curl_httppost *httppost;
+   SLang_MMT_Type *mime_mmt;	       /* For CURLOPT_MIMEPOST */
+   SLang_MMT_Type *share_mmt;	       /* For CURLOPT_SHARE */
+   SLang_BString_Type *postfields;     /* For binary CURLOPT_POSTFIELDS */
+   curl_off_t postfields_len;	       /* -1 if CURLOPT_POSTFIELDS is not set */
 
    struct Multi_Type *multi;	       /* NON-null if this is attached to a multi */
    struct Easy_Type *next;	       /* pointer to next one in multi stack */
+   struct Easy_Type *prev;	       /* pointer to previous one in multi stack */
+   int queue_priority;		       /* For CURLOPT_QUEUE_PRIORITY */
+   unsigned int queue_index;	       /* 1 + position in the queue of the multi, 0 if not queued */
+   double queue_tag;		       /* fair queueing finish tag */
+   unsigned long queue_seq;	       /* order of arrival in the queue */
+   struct Multi_Host_Type *queue_host;
+   struct Easy_Type *held_prev, *held_next;   /* For MULTI_HELD */
+   struct Easy_Type *done_prev, *done_next;   /* For MULTI_DONE */
+   CURLcode done_status;
+
+   /* Retry policy for transfers of a multi, see CURLOPT_RETRY_* */
+   unsigned int retry_max;	       /* 0 if failed transfers are not retried */
+   double retry_delay;
+   double retry_max_delay;
+   double retry_factor;
+   double retry_jitter;		       /* fraction of the delay that is random */
+   unsigned int retry_count;	       /* retries made so far */
+   double retry_at;		       /* For MULTI_RETRY */
+   struct Easy_Type *retry_prev, *retry_next;
+   long nosignal;		       /* value given to CURLOPT_NOSIGNAL */
+#ifdef HAVE_ASYNC
+   struct Easy_Type *async_next;       /* For the curl_perform_async queues */
+   CURLcode async_status;
+#endif
 }
 Easy_Type;
 
-typedef struct Multi_Type
+#ifdef HAVE_CURLOPT_MIMEPOST
+typedef struct
 {
-   CURLM *mhandle;
-   Easy_Type *ez;
-   unsigned int flags;
-   int length;
+   curl_mime *mime;
+   CURL *handle;		       /* the handle used to create it */
 }
-Multi_Type;
-
-/*{{{ Easy_Type Functions */
+Mime_Type;
+#endif
 
-static void free_easy_type (Easy_Type *ez)
+#ifdef HAVE_CURLOPT_SHARE
+typedef struct
 {
-   char **sp, **spmax;
-
-   if (ez == NULL)
-     return;
+   CURLSH *shandle;
+# ifdef HAVE_ASYNC
+   /* Handles performed by curl_perform_async may use the share from
+    * another thread.
+    */
+   pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+# endif
+}
+Share_Type;
+#endif
 
-   if (ez->handle != NULL)
-     curl_easy_cleanup (ez->handle);
+/* A token bucket holds up to burst tokens, and is refilled at rate tokens
+ * per second.  A rate of 0 means no limit.
+ */
+typedef struct
+{
+   double rate;
+   double burst;
+}
+Rate_Limit_Type;
 
-   if (ez->url != NULL)
-     SLang_free_slstring (ez->url);
+typedef struct
+{
+   double tokens;
+   double last;			       /* time of the last refill, 0 if full */
+}
+Token_Bucket_Type;
 
-   if (ez->write_callback != NULL) SLang_free_function (ez->write_callback);
-   if (ez->write_data != NULL) SLang_free_anytype (ez->write_data);
+/* The hosts of the transfers that have been queued by a Curl_Multi_Type */
+typedef struct Multi_Host_Type
+{
+   char *name;
+   double weight;		       /* For CURLMOPT_HOST_WEIGHT */
+   double last_tag;		       /* finish tag of the last queued transfer */
+   struct Multi_Host_Type *next;
+
+   /* A negative rate means that the limit of the multi for hosts applies */
+   Rate_Limit_Type request_limit;      /* For CURLMOPT_MAX_HOST_REQUEST_RATE */
+   Rate_Limit_Type byte_limit;	       /* For CURLMOPT_MAX_HOST_BYTE_RATE */
+   Token_Bucket_Type request_bucket;
+   Token_Bucket_Type byte_bucket;
+   /* Queued transfers that are held back by the limits, see MULTI_HELD */
+   Easy_Type *held_head, *held_tail;
+   double ready_at;		       /* when the limits permit another */
+   int is_held;			       /* non-zero if on the held_hosts list */
+   struct Multi_Host_Type *held_host_next;
+}
+Multi_Host_Type;
 
-   if (ez->read_callback != NULL) SLang_free_function (ez->read_callback);
-   if (ez->read_data != NULL) SLang_free_anytype (ez->read_data);
+#define MULTI_HOST_TABLE_SIZE 256
 
-   if (ez->writeheader_callback != NULL) SLang_free_function (ez->writeheader_callback);
-   if (ez->writeheader_data != NULL) SLang_free_anytype (ez->writeheader_data);
+typedef struct Multi_Type
+{
+   CURLM *mhandle;
+   Easy_Type *ez;
+   unsigned int flags;
+   int length;
+   /* Handles are queued until they can be admitted into libcurl without
+    * exceeding max_running.  The queue is a heap ordered by priority, then
+    * by the weighted fair queueing tags of their hosts, then by arrival.
+    */
+   unsigned int max_running;	       /* For CURLMOPT_MAX_RUNNING, 0 if unlimited */
+   unsigned int num_running;
+   Easy_Type **queue;
+   unsigned int num_queued;
+   unsigned int max_queued;
+   unsigned long queue_seq;
+   double vtime;		       /* finish tag of the last admitted transfer */
+   Multi_Host_Type *hosts[MULTI_HOST_TABLE_SIZE];
+   /* Completed transfers that have not been read by curl_multi_info_read */
+   Easy_Type *done_head, *done_tail;
+   /* Transfers that are waiting to be retried, soonest first */
+   Easy_Type *retry_head;
+   unsigned int num_retrying;
+   /* Rate limits that apply to the admission of the queued transfers */
+   int rate_limited;		       /* non-zero if any limit has been set */
+   Rate_Limit_Type request_limit;      /* For CURLMOPT_MAX_REQUEST_RATE */
+   Rate_Limit_Type byte_limit;	       /* For CURLMOPT_MAX_BYTE_RATE */
+   Rate_Limit_Type host_request_limit; /* For CURLMOPT_MAX_HOST_REQUEST_RATE */
+   Rate_Limit_Type host_byte_limit;    /* For CURLMOPT_MAX_HOST_BYTE_RATE */
+   Token_Bucket_Type request_bucket;
+   Token_Bucket_Type byte_bucket;
+   double ready_at;		       /* when the limits of the multi permit another */
+   Multi_Host_Type *held_hosts;	       /* hosts with held transfers */
+   unsigned int num_held;
+#ifdef HAVE_EPOLL
+   /* The following are used by curl_multi_run */
+   int epfd;
+   int wakeup_fd;		       /* eventfd signalled by curl_multi_wakeup */
+   int timer_set;
+   double timer_deadline;
+#endif
+}
+Multi_Type;
 
-   if (ez->progress_callback != NULL) SLang_free_function (ez->progress_callback);
-   if (ez->progress_data != NULL) SLang_free_anytype (ez->progress_data);
+/*{{{ Byte_Buffer_Type Functions */
 
-   sp = ez->opt_strings;
-   spmax = sp + NUM_OPT_STRINGS;
-   while (sp < spmax)
+static void free_byte_buffer (Byte_Buffer_Type *b)
+{
+   if (b->data != NULL)
      {
-	if (*sp != NULL)
-	  SLang_free_slstring (*sp);
-	sp++;
+	if (b->native)
+	  free (b->data);
+	else
+	  SLfree ((char *) b->data);
      }
-   if (ez->httpheader != NULL) curl_slist_free_all (ez->httpheader);
-   if (ez->http200aliases != NULL) curl_slist_free_all (ez->http200aliases);
-   if (ez->quote != NULL) curl_slist_free_all (ez->quote);
-   if (ez->postquote != NULL) curl_slist_free_all (ez->postquote);
-   if (ez->prequote != NULL) curl_slist_free_all (ez->prequote);
-   if (ez->source_quote != NULL) curl_slist_free_all (ez->source_quote);
-   if (ez->source_prequote != NULL) curl_slist_free_all (ez->source_prequote);
-   if (ez->source_postquote != NULL) curl_slist_free_all (ez->source_postquote);
-
-   SLfree ((char *) ez);
+   b->data = NULL;
+   b->len = b->max = 0;
 }
 
-static void throw_curl_error (CURLcode err, char *buf)
+/* This selects the allocator of the buffer, which must be done while it
+ * is not in use.
+ */
+static void set_byte_buffer_native (Byte_Buffer_Type *b, int native)
 {
-   SLang_verror (Curl_Error, "%s: %s", curl_easy_strerror(err), buf);
+   if (b->native == native)
+     return;
+   free_byte_buffer (b);
+   b->native = native;
 }
 
-static int Initialized = 0;
-static void global_init (long *flagsp)
+/* Make sure that the buffer can hold at least len bytes */
+static int reserve_byte_buffer (Byte_Buffer_Type *b, size_t len)
 {
-   long flags = *flagsp;
+   unsigned char *data;
+   size_t max;
 
-   /* This cannot be called more than once. */
-   if (Initialized)
-     return;
+   if (len <= b->max)
+     return 0;
 
-   flags &= CURL_GLOBAL_ALL;
+   max = 2 * b->max;
+   if (max < len) max = len;
+   if (max < 4096) max = 4096;
 
-   if (0 != curl_global_init (flags))
-     {
-	SLang_verror (SL_RunTime_Error, "curl_global_init failed");
-	return;
-     }
-   Initialized = 1;
+   if (b->native)
+     data = (unsigned char *) realloc (b->data, max);
+   else
+     data = (unsigned char *) SLrealloc ((char *) b->data, max);
+   if (data == NULL)
+     return -1;
+
+   b->data = data;
+   b->max = max;
+   return 0;
 }
 
-static void global_cleanup (void)
+static int append_byte_buffer (Byte_Buffer_Type *b, unsigned char *bytes, size_t len)
 {
-   curl_global_cleanup ();
-   Initialized = 0;
+   if (len == 0)
+     return 0;
+
+   if ((len > b->max - b->len)
+       && (-1 == reserve_byte_buffer (b, b->len + len)))
+     return -1;
+
+   memcpy (b->data + b->len, bytes, len);
+   b->len += len;
+   return 0;
 }
 
-static size_t write_function_internal (void *ptr, size_t size, size_t nmemb,
-				       SLang_Name_Type *write_callback,
-				       SLang_Any_Type *write_data)
+/* This hands the contents of the buffer over to a BString, leaving the
+ * buffer empty.
+ */
+static SLang_BString_Type *byte_buffer_to_bstring (Byte_Buffer_Type *b)
 {
    SLang_BString_Type *bstr;
-   int status;
 
-   if (NULL == (bstr = SLbstring_create ((unsigned char *)ptr, size * nmemb)))
+   if (b->data == NULL)
+     return SLbstring_create ((unsigned char *) "", 0);
+
+   if (b->native)
      {
-	return (size_t)0;	       /* error */
+	/* The BString must own memory from the S-Lang allocator */
+	if (NULL == (bstr = SLbstring_create (b->data, b->len)))
+	  return NULL;
+	free_byte_buffer (b);
+	return bstr;
      }
-   if ((-1 == SLang_start_arg_list ())
-       || (-1 == SLang_push_anytype (write_data))
-       || (-1 == SLang_push_bstring (bstr))
-       || (-1 == SLang_end_arg_list ())
-       || (-1 == SLexecute_function (write_callback))
-       || (-1 == SLang_pop_int (&status)))
-     status = -1;
 
-   SLbstring_free (bstr);
-
-   if (status != -1)
-     return size * nmemb;
+   if (NULL == (bstr = SLbstring_create_malloced (b->data, b->len, 0)))
+     return NULL;
 
-   /* error */
-   return (size_t)0;
+   b->data = NULL;
+   b->len = b->max = 0;
+   return bstr;
 }
 
-/* slang: Int_Type write_function (writedata, string);
- * return values: success: 0, error: -1
- */
-static size_t write_function (void *ptr, size_t size, size_t nmemb, void *stream)
-{
-   Easy_Type *ez;
+/*}}}*/
 
-   ez = (Easy_Type *) stream;
-   return write_function_internal (ptr, size, nmemb, ez->write_callback, ez->write_data);
-}
+/*{{{ File_Sink_Type Functions */
 
-static size_t write_header_function (void *ptr, size_t size, size_t nmemb, void *stream)
+static void init_file_sink (File_Sink_Type *fs)
 {
-   Easy_Type *ez;
-
-   ez = (Easy_Type *) stream;
-   return write_function_internal (ptr, size, nmemb, ez->writeheader_callback, ez->writeheader_data);
+   memset ((char *) fs, 0, sizeof (File_Sink_Type));
+   fs->user_fd = -1;
+   fs->fd = -1;
+   fs->reserved_from = -1;
 }
 
-static int progress_function (void *clientp, double dltotal, double dlnow, double ultotal, double ulnow)
+static void close_file_sink_fd (File_Sink_Type *fs)
 {
-   Easy_Type *ez;
-   int status;
-
-   ez = (Easy_Type *)clientp;
-   if ((-1 == SLang_start_arg_list ())
-       || (-1 == SLang_push_anytype (ez->progress_data))
-       || (-1 == SLang_push_double (dltotal))
-       || (-1 == SLang_push_double (dlnow))
-       || (-1 == SLang_push_double (ultotal))
-       || (-1 == SLang_push_double (ulnow))
-       || (-1 == SLang_end_arg_list ())
-       || (-1 == SLexecute_function (ez->progress_callback))
-       || (-1 == SLang_pop_int (&status)))
-     status = -1;
+   if ((fs->fd != -1) && (fs->fd != fs->user_fd))
+     (void) close (fs->fd);
+   fs->fd = -1;
+   if (fs->tmp_path != NULL)
+     {
+	(void) unlink (fs->tmp_path);
+	SLfree (fs->tmp_path);
+	fs->tmp_path = NULL;
+     }
+}
 
-   return status;
+static void free_file_sink (File_Sink_Type *fs)
+{
+   close_file_sink_fd (fs);
+   if (fs->user_fd != -1)
+     (void) close (fs->user_fd);
+   if (fs->path != NULL)
+     SLang_free_slstring (fs->path);
+   free_byte_buffer (&fs->stage);
+   init_file_sink (fs);
 }
 
-/* slang: Bstring read_function (Object, num_bytes)
- *
- *   If NULL returned, operation will be aborted.
+/* The file creation mask of the process.  Since umask can only be read by
+ * setting it, which affects every thread, this is done once at load time.
  */
-static size_t read_function (void *ptr, size_t size, size_t nmemb, void *stream)
+static mode_t File_Sink_Umask = 022;
+static int File_Sink_Umask_Read = 0;
+
+static void read_file_sink_umask (void)
 {
-   Easy_Type *ez;
-   SLang_BString_Type *bstr;
-   SLstrlen_Type bytes_read, bytes_requested;
-   unsigned char *bytes;
+   if (File_Sink_Umask_Read)
+     return;
+   File_Sink_Umask = umask (022);
+   (void) umask (File_Sink_Umask);
+   File_Sink_Umask_Read = 1;
+}
 
-   bytes_requested = (unsigned int) (size * nmemb);
+/* Called at the start of a transfer to get a descriptor to write to */
+static int open_file_sink (File_Sink_Type *fs)
+{
+   close_file_sink_fd (fs);
 
-   ez = (Easy_Type *) stream;
-   if ((-1 == SLang_start_arg_list ())
-       || (-1 == ((ez->read_data == NULL)
-		  ? SLang_push_mmt (ez->mmt)
-		  : SLang_push_anytype (ez->read_data)))
-       || (-1 == SLang_push_long (bytes_requested))
-       || (-1 == SLang_end_arg_list ())
-       || (-1 == SLexecute_function (ez->read_callback)))
+   if (fs->path != NULL)
      {
-	return CURL_READFUNC_ABORT;
-     }
+	size_t len = strlen (fs->path);
 
-   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
-     {
-	(void) SLang_pop_null ();
-	return CURL_READFUNC_ABORT;
-     }
+	if (NULL == (fs->tmp_path = SLmalloc (len + 8)))
+	  return -1;
+	memcpy (fs->tmp_path, fs->path, len);
+	strcpy (fs->tmp_path + len, ".XXXXXX");
 
-   if (-1 == SLang_pop_bstring (&bstr))
-     {
-	return CURL_READFUNC_ABORT;
+	if (-1 == (fs->fd = mkstemp (fs->tmp_path)))
+	  {
+	     SLang_verror (SL_Open_Error, "Unable to create a temporary file for %s: %s",
+			   fs->path, strerror (errno));
+	     SLfree (fs->tmp_path);
+	     fs->tmp_path = NULL;
+	     return -1;
+	  }
+	/* mkstemp uses 0600, but the file should look like any other */
+	(void) fchmod (fs->fd, 0666 & ~File_Sink_Umask);
+	fs->start_offset = 0;
+	fs->seekable = 1;
      }
-
-   if (NULL == (bytes = SLbstring_get_pointer (bstr, &bytes_read)))
+   else
      {
-	SLbstring_free (bstr);
-	return CURL_READFUNC_ABORT;
-     }
-
-   if (bytes_read > bytes_requested)
-     bytes_read = bytes_requested;
-
-   memcpy ((char *) ptr, bytes, bytes_read);
+	off_t pos;
 
-   SLbstring_free (bstr);
-   return bytes_read;
+	fs->fd = fs->user_fd;
+	pos = lseek (fs->fd, 0, SEEK_CUR);
+	fs->seekable = (pos != (off_t) -1);
+	fs->start_offset = fs->seekable ? (curl_off_t) pos : 0;
+     }
+   fs->offset = fs->start_offset;
+   fs->reserved_from = -1;
+   fs->stage.len = 0;
+   return 0;
 }
 
-static int check_handle (Easy_Type *ez, unsigned int flags)
+static int write_file_sink_fd (File_Sink_Type *fs, unsigned char *bytes, size_t len)
 {
-   if ((ez == NULL) || (ez->handle == NULL))
+   while (len)
      {
-	SLang_verror (SL_RunTime_Error, "Curl_Type object has already been closed and may not be reused");
-	return -1;
-     }
-   if (ez->flags & flags)
-     {
-	SLang_verror (SL_RunTime_Error, "It is illegal to call this function while curl_perform is running");
-	return -1;
-     }
+	ssize_t n;
+
+	if (fs->seekable)
+	  n = pwrite (fs->fd, bytes, len, (off_t) fs->offset);
+	else
+	  n = write (fs->fd, bytes, len);
 
+	if (n == -1)
+	  {
+	     if (errno == EINTR)
+	       continue;
+	     return -1;
+	  }
+	bytes += n;
+	len -= n;
+	fs->offset += n;
+     }
    return 0;
 }
 
-static SLang_MMT_Type *pop_easy_type (Easy_Type **ezp, unsigned int flags)
+static int flush_file_sink (File_Sink_Type *fs)
 {
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
+   if (fs->stage.len == 0)
+     return 0;
+   if (-1 == write_file_sink_fd (fs, fs->stage.data, fs->stage.len))
+     return -1;
+   fs->stage.len = 0;
+   return 0;
+}
 
-   if (NULL == (mmt = SLang_pop_mmt (Easy_Type_Id)))
-     {
-	*ezp = NULL;
-	return NULL;
-     }
+/* The space reserved for the Content-Length extends the file, which may be
+ * more than the body: the length is that of the encoded body, and the
+ * transfer may have failed.  Cut the file back to what was written, but
+ * not below its original size.
+ */
+static int trim_file_sink (File_Sink_Type *fs)
+{
+   curl_off_t size = fs->reserved_from;
 
-   ez = (Easy_Type *)SLang_object_from_mmt (mmt);
-   if (-1 == check_handle (ez, flags))
+   if (size == -1)
+     return 0;
+   fs->reserved_from = -1;
+   if (size < fs->offset)
+     size = fs->offset;
+   while (-1 == ftruncate (fs->fd, (off_t) size))
      {
-	SLang_free_mmt (mmt);
-	return NULL;
+	if (errno != EINTR)
+	  return -1;
      }
-   *ezp = ez;
-   return mmt;
+   return 0;
 }
 
-static int set_long_opt (Easy_Type *ez, CURLoption opt, int nargs, int use_def, long val)
+/* Called at the end of a transfer.  If ok is zero, the transfer failed and
+ * any temporary file is removed.  Since this may be called when it is not
+ * appropriate to throw an exception, a failure is described in errbuf.
+ */
+static int close_file_sink (File_Sink_Type *fs, int ok, char *errbuf)
 {
-   CURLcode status;
+   int status = 0;
 
-   if ((nargs > 1)
-       || ((nargs == 0) && (use_def == 0)))
+   if (fs->fd == -1)
+     return 0;
+
+   if (ok)
      {
-	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL option");
-	return -1;
+	int fd = fs->fd;
+
+	if ((-1 == flush_file_sink (fs))
+	    || (-1 == trim_file_sink (fs))
+	    || (fs->seekable && (-1 == fsync (fd)) && (errno != EINVAL)))
+	  status = -1;
+
+	if (fs->tmp_path != NULL)
+	  {
+	     fs->fd = -1;
+	     if ((-1 == close (fd)) && (status == 0))
+	       status = -1;
+	  }
+
+	if (status == -1)
+	  (void) SLsnprintf (errbuf, CURL_ERROR_SIZE, "Error writing to %s: %s",
+			     (fs->path != NULL) ? fs->path : "file descriptor",
+			     strerror (errno));
+	else if (fs->tmp_path != NULL)
+	  {
+	     if (-1 == rename (fs->tmp_path, fs->path))
+	       {
+		  (void) SLsnprintf (errbuf, CURL_ERROR_SIZE, "Unable to rename %s to %s: %s",
+				     fs->tmp_path, fs->path, strerror (errno));
+		  status = -1;
+	       }
+	     else
+	       {
+		  SLfree (fs->tmp_path);
+		  fs->tmp_path = NULL;
+	       }
+	  }
+     }
+   else if (fs->tmp_path == NULL)
+     {
+	/* Do not leave the reserved space in the caller's file */
+	(void) trim_file_sink (fs);
      }
+   fs->stage.len = 0;
+   close_file_sink_fd (fs);
+   return status;
+}
 
-   if (nargs && (-1 == SLang_pop_long (&val)))
-     return -1;
+/*}}}*/
 
-   status = curl_easy_setopt (ez->handle, opt, val);
-   if (status == CURLE_OK)
-     return 0;
+/*{{{ Read_Source_Type Functions */
 
-   throw_curl_error (status, ez->errbuf);
-   return -1;
+static void init_read_source (Read_Source_Type *rs)
+{
+   memset ((char *) rs, 0, sizeof (Read_Source_Type));
+   rs->fd = -1;
 }
 
-typedef size_t (*CFUNC_Type)(void *, size_t, size_t, void *);
+static void free_read_source (Read_Source_Type *rs)
+{
+#ifdef HAVE_MMAP
+   if (rs->map != NULL)
+     (void) munmap ((char *) rs->map, rs->map_len);
+#endif
+   if (rs->bstr != NULL)
+     SLbstring_free (rs->bstr);
+   if (rs->fd != -1)
+     (void) close (rs->fd);
+   init_read_source (rs);
+}
 
-static int set_function_opt (Easy_Type *ez, CURLoption opt, CURLoption data_opt, int nargs,
-			     SLang_Name_Type **funcp, SLang_Any_Type **datap,
-			     CFUNC_Type callback)
+/* Sets up a source that reads from the descriptor fd, which it takes over.
+ * Regular files are mmapped if possible.
+ */
+static int open_fd_read_source (Read_Source_Type *rs, int fd, int use_mmap)
 {
-   SLang_Any_Type *data;
-   SLang_Name_Type *func;
+   struct stat st;
+   off_t pos;
+
+   rs->fd = fd;
+   rs->type = READ_SOURCE_FD;
+   rs->size = -1;
+
+   pos = lseek (fd, 0, SEEK_CUR);
+   rs->seekable = (pos != (off_t) -1);
+   if ((-1 == fstat (fd, &st))
+       || (0 == S_ISREG(st.st_mode))
+       || (rs->seekable == 0))
+     return 0;
 
-   if (nargs != 2)
+   rs->start = (curl_off_t) pos;
+   rs->size = (st.st_size > pos) ? (curl_off_t) (st.st_size - pos) : 0;
+
+#ifdef HAVE_MMAP
+   if (use_mmap && (pos == 0) && (rs->size > 0)
+       && ((curl_off_t) (size_t) rs->size == rs->size))
      {
-	SLang_verror (SL_INVALID_PARM, "Expecting two arguments for this option");
-	return -1;
+	void *map = mmap (NULL, (size_t) rs->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map != MAP_FAILED)
+	  {
+# if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+	     (void) posix_madvise (map, (size_t) rs->size, POSIX_MADV_SEQUENTIAL);
+# endif
+	     rs->map = (unsigned char *) map;
+	     rs->map_len = (size_t) rs->size;
+	     rs->data = rs->map;
+	     rs->type = READ_SOURCE_MEMORY;
+	     (void) close (fd);
+	     rs->fd = -1;
+	  }
      }
+#else
+   (void) use_mmap;
+#endif
+   return 0;
+}
 
-   if (NULL == (func = SLang_pop_function ()))
-     return -1;
+/* Returns the number of bytes copied to buf, or -1 upon error */
+static long read_from_source (Read_Source_Type *rs, unsigned char *buf, size_t len)
+{
+   ssize_t n;
 
-   if (-1 == SLang_pop_anytype (&data))
-     {
-	SLang_free_function (func);
-	return -1;
-     }
+   if ((rs->size >= 0) && ((curl_off_t) len > rs->size - rs->offset))
+     len = (size_t) (rs->size - rs->offset);
 
-   if ((CURLE_OK != curl_easy_setopt (ez->handle, opt, callback))
-       || (CURLE_OK != curl_easy_setopt (ez->handle, data_opt, ez)))
+   if (rs->type == READ_SOURCE_MEMORY)
      {
-	SLang_free_function (func);
-	SLang_free_anytype (data);
-	return -1;
+	memcpy (buf, rs->data + rs->offset, len);
+	rs->offset += len;
+	return (long) len;
      }
 
-   if (NULL != *funcp)
-     SLang_free_function (*funcp);
-   *funcp = func;
+   while (1)
+     {
+	if (rs->seekable)
+	  n = pread (rs->fd, buf, len, (off_t) (rs->start + rs->offset));
+	else
+	  n = read (rs->fd, buf, len);
 
-   if (NULL != *datap)
-     SLang_free_anytype (*datap);
-   *datap = data;
+	if ((n == -1) && (errno == EINTR))
+	  continue;
+	break;
+     }
+   if (n > 0)
+     rs->offset += n;
+   return (long) n;
+}
 
+static int seek_read_source (Read_Source_Type *rs, curl_off_t offset)
+{
+   if ((rs->type == READ_SOURCE_FD) && (rs->seekable == 0))
+     return -1;
+   if ((offset < 0) || ((rs->size >= 0) && (offset > rs->size)))
+     return -1;
+   rs->offset = offset;
    return 0;
 }
 
-static int set_string_opt_internal (Easy_Type *ez, CURLoption opt, char *str)
+/*}}}*/
+
+/*{{{ Framer_Type Functions */
+
+static void free_framer_records (Framer_Type *fr)
 {
-   char *old;
-   CURLcode status;
-   int indx;
+   SLindex_Type i;
 
-   indx = opt - (int)CURLOPTTYPE_OBJECTPOINT;
-   if ((indx < 0) || (indx >= (int)NUM_OPT_STRINGS))
+   for (i = 0; i < fr->num_records; i++)
      {
-	SLang_verror (SL_Internal_Error, "Unexpected Curl option value %d", opt);
-	return -1;
+	if (fr->type == CURL_FRAME_LENGTH32)
+	  SLbstring_free ((SLang_BString_Type *) fr->records[i]);
+	else
+	  SLang_free_slstring ((char *) fr->records[i]);
      }
-   old = ez->opt_strings[indx];
+   fr->num_records = 0;
+}
 
-   if (old == str)
-     return 0;
+/* Discards any partial record, e.g., when a new transfer starts */
+static void reset_framer (Framer_Type *fr)
+{
+   free_framer_records (fr);
+   fr->buf.len = 0;
+   fr->event.len = 0;
+   fr->have_event = 0;
+}
 
-   if ((str != NULL)
-       && (NULL == (str = SLang_create_slstring (str))))
-     return -1;
-   status = curl_easy_setopt (ez->handle, opt, str);
-   if (status != CURLE_OK)
-     {
-	throw_curl_error (status, ez->errbuf);
-	if (str != NULL) SLang_free_slstring (str);
-	return -1;
-     }
-   ez->opt_strings[indx] = str;
-   SLang_free_slstring (old);
+static void free_framer (Framer_Type *fr)
+{
+   free_framer_records (fr);
+   if (fr->records != NULL)
+     SLfree ((char *) fr->records);
+   fr->records = NULL;
+   fr->max_records = 0;
+   free_byte_buffer (&fr->buf);
+   free_byte_buffer (&fr->event);
+}
 
-   if (opt == CURLOPT_URL)
+static int add_framer_record (Framer_Type *fr, unsigned char *bytes, size_t len)
+{
+   VOID_STAR rec;
+
+   if (fr->num_records == fr->max_records)
      {
-	if ((str != NULL)
-	    && (NULL == (str = SLang_create_slstring (str))))
+	SLindex_Type max = fr->max_records ? 2 * fr->max_records : 64;
+	VOID_STAR *records = (VOID_STAR *) SLrealloc ((char *) fr->records, max * sizeof (VOID_STAR));
+	if (records == NULL)
 	  return -1;
-	SLang_free_slstring (ez->url);
-	ez->url = str;
+	fr->records = records;
+	fr->max_records = max;
      }
+
+   if (bytes == NULL)
+     bytes = (unsigned char *) "";
+
+   if (fr->type == CURL_FRAME_LENGTH32)
+     rec = (VOID_STAR) SLbstring_create (bytes, len);
+   else
+     rec = (VOID_STAR) SLang_create_nslstring ((char *) bytes, len);
+
+   if (rec == NULL)
+     return -1;
+
+   fr->records[fr->num_records++] = rec;
    return 0;
 }
 
-static int set_string_opt (Easy_Type *ez, CURLoption opt, int nargs)
+/* Processes a line of an event stream, which has had its EOL removed.
+ * Only the data fields are used; comments and other fields are ignored.
+ */
+static int frame_sse_line (Framer_Type *fr, unsigned char *line, size_t len)
 {
-   char *str;
-   int ret;
-
-   if (nargs != 1)
+   if (len == 0)
      {
-	SLang_verror (SL_INVALID_PARM, "Expecting a single string argument");
-	return -1;
+	/* A blank line dispatches the event */
+	if (fr->have_event
+	    && (-1 == add_framer_record (fr, fr->event.data, fr->event.len)))
+	  return -1;
+	fr->have_event = 0;
+	fr->event.len = 0;
+	return 0;
      }
-   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+
+   if ((len < 4) || (0 != memcmp (line, "data", 4)))
+     return 0;
+
+   line += 4; len -= 4;
+   if (len)
      {
-	SLang_pop_null ();
-	str = NULL;
+	if (*line != ':')
+	  return 0;
+	line++; len--;
+	if (len && (*line == ' '))
+	  {
+	     line++; len--;
+	  }
      }
-   else if (-1 == SLang_pop_slstring (&str))
+
+   /* Multiple data fields are joined by newlines */
+   if ((fr->have_event
+	&& (-1 == append_byte_buffer (&fr->event, (unsigned char *) "\n", 1)))
+       || (-1 == append_byte_buffer (&fr->event, line, len)))
      return -1;
 
-   ret = set_string_opt_internal (ez, opt, str);
-   if (str != NULL) SLang_free_slstring (str);
-   return ret;
+   fr->have_event = 1;
+   return 0;
 }
 
-static int set_strlist_opt (Easy_Type *ez, CURLoption opt, int nargs,
-			    struct curl_slist **slistp)
+/* Splits off the complete records in bytes, and returns the number of bytes
+ * consumed, or -1 upon error.  If final is non-zero, there will be no more
+ * data.
+ */
+static long frame_records (Framer_Type *fr, unsigned char *bytes, size_t len, int final)
 {
-   struct curl_slist *slist = NULL;
-   CURLcode status;
+   unsigned char *p = bytes, *pmax = bytes + len;
 
-   if (nargs > 1)
+   if (fr->type == CURL_FRAME_LENGTH32)
      {
-	SLang_verror (SL_INVALID_PARM, "This option requires an array of strings");
-	return -1;
+	while (pmax - p >= 4)
+	  {
+	     size_t n = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+	     if ((size_t)(pmax - p) - 4 < n)
+	       break;
+	     if (-1 == add_framer_record (fr, p + 4, n))
+	       return -1;
+	     p += 4 + n;
+	  }
+	if (final && (p != pmax))
+	  {
+	     SLang_verror (SL_Read_Error, "The body ended with an incomplete frame");
+	     return -1;
+	  }
+	return (long) (p - bytes);
      }
 
-   if (nargs == 1)
+   while (p < pmax)
      {
-	SLang_Array_Type *at;
-	char **sp, **spmax;
+	unsigned char *eol = (unsigned char *) memchr (p, '\n', pmax - p);
+	unsigned char *next;
+	size_t n;
 
-	if (-1 == SLang_pop_array_of_type (&at, SLANG_STRING_TYPE))
-	  return -1;
-	sp = (char **)at->data;
-	spmax = sp + at->num_elements;
+	if (eol == NULL)
+	  {
+	     if (final == 0)
+	       break;
+	     eol = next = pmax;
+	  }
+	else next = eol + 1;
 
-	while (sp < spmax)
+	n = eol - p;
+	if (n && (p[n-1] == '\r'))
+	  n--;
+
+	if (fr->type == CURL_FRAME_SSE)
 	  {
-	     if (*sp != NULL)
-	       {
-		  struct curl_slist *olist = slist;
-		  if (NULL == (slist = curl_slist_append (olist, *sp)))
-		    {
-		       SLang_verror (Curl_Error, "Error in building a cURL list");
-		       curl_slist_free_all (olist);
-		       SLang_free_array (at);
-		       return -1;
-		    }
-	       }
-	     sp++;
+	     if (-1 == frame_sse_line (fr, p, n))
+	       return -1;
 	  }
-	SLang_free_array (at);
+	else if (n && (-1 == add_framer_record (fr, p, n)))
+	  return -1;
+
+	p = next;
      }
+   return (long) (p - bytes);
+}
 
-   if (*slistp != NULL)
+/* Adds the bytes to the framer and splits off the complete records */
+static int framer_push_bytes (Framer_Type *fr, unsigned char *bytes, size_t len, int final)
+{
+   Byte_Buffer_Type *b = &fr->buf;
+   long n;
+
+   if (b->len == 0)
      {
-	curl_slist_free_all (*slistp);
-	*slistp = NULL;
+	/* Frame directly from the caller's buffer and save the remainder */
+	if (-1 == (n = frame_records (fr, bytes, len, final)))
+	  return -1;
+	return append_byte_buffer (b, bytes + n, len - n);
      }
 
-   status = curl_easy_setopt (ez->handle, opt, slist);
-
-   if (status != CURLE_OK)
+   if (-1 == append_byte_buffer (b, bytes, len))
+     return -1;
+   if (-1 == (n = frame_records (fr, b->data, b->len, final)))
+     return -1;
+   if (n)
      {
-	if (slist != NULL)
-	  curl_slist_free_all (slist);
-	throw_curl_error (status, ez->errbuf);
-	return -1;
+	b->len -= n;
+	memmove (b->data, b->data + n, b->len);
      }
-   *slistp = slist;
    return 0;
 }
 
-static int do_setopt (Easy_Type *ez, CURLoption opt, int nargs)
-{
-   switch (opt)
-     {
-	/* behavior options (long arg) */
-      case CURLOPT_VERBOSE:
-      case CURLOPT_HEADER:
-      case CURLOPT_NOPROGRESS:
-      case CURLOPT_NOSIGNAL:	       /* May not want to support this */
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+/*}}}*/
 
-	/* Callback Options */
-      case CURLOPT_WRITEFUNCTION:
-	return set_function_opt (ez, opt, CURLOPT_WRITEDATA, nargs, &ez->write_callback, &ez->write_data, write_function);
+/*{{{ Digest_Type Functions */
 
-      case CURLOPT_READFUNCTION:
-	return set_function_opt (ez, opt, CURLOPT_READDATA, nargs, &ez->read_callback, &ez->read_data, read_function);
-
-#ifdef HAVE_CURLOPT_SEEKFUNCTION
-      case CURLOPT_SEEKFUNCTION:
-#else
-      case CURLOPT_IOCTLFUNCTION:
-#endif
-	break;
+static uint32_t CRC32C_Table[256];
 
-#ifdef HAVE_CURLOPT_XFERINFOFUNCTION
-      case CURLOPT_XFERINFOFUNCTION:
-#else
-      case CURLOPT_PROGRESSFUNCTION:
-#endif
-	(void) curl_easy_setopt (ez->handle, CURLOPT_NOPROGRESS, 0);
-	return set_function_opt (ez, opt, CURLOPT_PROGRESSDATA, nargs, &ez->progress_callback, &ez->progress_data, (CFUNC_Type)progress_function);
-	break;
+static void init_crc32c_table (void)
+{
+   uint32_t i;
 
-      case CURLOPT_HEADERFUNCTION:
-	return set_function_opt (ez, opt, CURLOPT_WRITEHEADER, nargs, &ez->writeheader_callback, &ez->writeheader_data, write_header_function);
+   if (CRC32C_Table[1] != 0)
+     return;
 
-      case CURLOPT_DEBUGFUNCTION:
-      case CURLOPT_SSL_CTX_FUNCTION:
-	break;
+   for (i = 0; i < 256; i++)
+     {
+	uint32_t c = i;
+	int j;
+	for (j = 0; j < 8; j++)
+	  c = (c & 1) ? (0x82F63B78U ^ (c >> 1)) : (c >> 1);
+	CRC32C_Table[i] = c;
+     }
+}
 
-	/* data options */
-      case CURLOPT_WRITEDATA:
-	/* return set_write_data_opt (ez, opt, CURLOPT_WRITEDATA, nargs); */
-      case CURLOPT_READDATA:
-#ifdef HAVE_CURLOPT_SEEKDATA
-      case CURLOPT_SEEKDATA:
+static uint32_t update_crc32c (uint32_t crc, unsigned char *p, size_t len)
+{
+#if defined(__SSE4_2__)
+   while (len && ((uintptr_t) p & 7))
+     {
+	crc = _mm_crc32_u8 (crc, *p++);
+	len--;
+     }
+# if defined(__x86_64__)
+   while (len >= 8)
+     {
+	crc = (uint32_t) _mm_crc32_u64 (crc, *(uint64_t *) p);
+	p += 8;
+	len -= 8;
+     }
+# endif
+   while (len--)
+     crc = _mm_crc32_u8 (crc, *p++);
 #else
-      case CURLOPT_IOCTLDATA:
+   while (len--)
+     crc = CRC32C_Table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
 #endif
-      case CURLOPT_PROGRESSDATA:
-      case CURLOPT_WRITEHEADER:
-      case CURLOPT_DEBUGDATA:
-      case CURLOPT_SSL_CTX_DATA:
-	break;
-
-	/* error options */
-      case CURLOPT_ERRORBUFFER:
-      case CURLOPT_STDERR:
-      case CURLOPT_FAILONERROR:
-	break;
-
-	/* network options */
-      case CURLOPT_URL:		       /* required option */
-      case CURLOPT_PROXY:
-	return set_string_opt (ez, opt, nargs);
-
-      case CURLOPT_PROXYPORT:
-	return set_long_opt (ez, opt, nargs, 0, 0);
+   return crc;
+}
 
-      case CURLOPT_PROXYTYPE:
-	return set_long_opt (ez, opt, nargs, 0, 0);   /* only certain values allowed */
+static const uint32_t SHA256_K[64] =
+{
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
 
-      case CURLOPT_HTTPPROXYTUNNEL:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+#define ROTR32(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
 
-      case CURLOPT_INTERFACE:
-	return set_string_opt (ez, opt, nargs);
+static void sha256_transform (uint32_t *state, unsigned char *block)
+{
+   uint32_t w[64];
+   uint32_t a, b, c, d, e, f, g, h;
+   int i;
 
-      case CURLOPT_DNS_CACHE_TIMEOUT:
-	return set_long_opt (ez, opt, nargs, 1, 0L);
+   for (i = 0; i < 16; i++)
+     w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i+1] << 16)
+       | ((uint32_t)block[4*i+2] << 8) | (uint32_t)block[4*i+3];
 
-#ifdef HAVE_CURLOPT_SHARE   /* obsolete and not encouraged */
-      case CURLOPT_SHARE:
-#else
-      case CURLOPT_DNS_USE_GLOBAL_CACHE:   /* obsolete and not encouraged */
-#endif
-	break;
+   for (i = 16; i < 64; i++)
+     {
+	uint32_t s0 = ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+	uint32_t s1 = ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+	w[i] = w[i-16] + s0 + w[i-7] + s1;
+     }
 
-      case CURLOPT_BUFFERSIZE:
-	break;
+   a = state[0]; b = state[1]; c = state[2]; d = state[3];
+   e = state[4]; f = state[5]; g = state[6]; h = state[7];
 
-      case CURLOPT_PORT:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   for (i = 0; i < 64; i++)
+     {
+	uint32_t s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+	uint32_t ch = (e & f) ^ (~e & g);
+	uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+	uint32_t s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+	uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+	uint32_t t2 = s0 + maj;
+
+	h = g; g = f; f = e; e = d + t1;
+	d = c; c = b; b = a; a = t1 + t2;
+     }
 
-      case CURLOPT_TCP_NODELAY:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+   state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+   state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
 
-	/* names and password options */
-      case CURLOPT_NETRC:
-	return set_long_opt (ez, opt, nargs, 0, 0L);   /* FIXME */
+static void update_sha256 (Digest_Type *d, unsigned char *p, size_t len)
+{
+   size_t n = (size_t) (d->count & 63);
 
-      case CURLOPT_NETRC_FILE:
-#ifdef HAVE_CURLOPT_USERPWD
-      case CURLOPT_USERPWD:
-#endif
-      case CURLOPT_PROXYUSERPWD:
-	return set_string_opt (ez, opt, nargs);
+   d->count += len;
 
-      case CURLOPT_HTTPAUTH:
-      case CURLOPT_PROXYAUTH:
-	return set_long_opt (ez, opt, nargs, 0, 0L);   /* FIXME */
+   if (n)
+     {
+	size_t dn = 64 - n;
+	if (len < dn)
+	  {
+	     memcpy (d->block + n, p, len);
+	     return;
+	  }
+	memcpy (d->block + n, p, dn);
+	sha256_transform (d->state, d->block);
+	p += dn;
+	len -= dn;
+     }
 
-	/* HTTP options */
-      case CURLOPT_AUTOREFERER:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
-#ifdef HAVE_CURLOPT_ACCEPT_ENCODING
-      case CURLOPT_ACCEPT_ENCODING:
-#else
-      case CURLOPT_ENCODING:
-#endif
-	return set_string_opt (ez, opt, nargs);
+   while (len >= 64)
+     {
+	sha256_transform (d->state, p);
+	p += 64;
+	len -= 64;
+     }
+   memcpy (d->block, p, len);
+}
 
-      case CURLOPT_FOLLOWLOCATION:
-      case CURLOPT_UNRESTRICTED_AUTH:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
-      case CURLOPT_MAXREDIRS:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+static void init_digest (Digest_Type *d)
+{
+   static const uint32_t sha256_init[8] =
+     {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+     };
 
-#ifdef HAVE_CURLOPT_UPLOAD
-      case CURLOPT_UPLOAD:
-#else
-      case CURLOPT_PUT:		       /* deprecated */
-#endif
-      case CURLOPT_POST:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+   d->crc = 0xFFFFFFFFU;
+   d->count = 0;
+   memcpy ((char *) d->state, (char *) sha256_init, sizeof (sha256_init));
+}
 
-      case CURLOPT_POSTFIELDS:	       /* FIXME allow binary */
-	return set_string_opt (ez, opt, nargs);
-      case CURLOPT_POSTFIELDSIZE:      /* FIXME: combine with above */
-	break;
-      case CURLOPT_POSTFIELDSIZE_LARGE:/* FIXME: combine with above */
+static void update_digest (Digest_Type *d, unsigned char *p, size_t len)
+{
+   switch (d->type)
+     {
+      case CURL_DIGEST_CRC32C:
+	d->crc = update_crc32c (d->crc, p, len);
 	break;
 
-#ifdef HAVE_CURLOPT_MIMEPOST
-      case CURLOPT_MIMEPOST:
-#else
-      case CURLOPT_HTTPPOST:	       /* FIXME: linked list */
-#endif
+      case CURL_DIGEST_SHA256:
+	update_sha256 (d, p, len);
 	break;
+     }
+}
 
-      case CURLOPT_REFERER:
-	return set_string_opt (ez, opt, nargs);
+/* Writes the digest of the data processed so far to buf, and returns its
+ * length.  The digest itself is not modified.
+ */
+static unsigned int get_digest_bytes (Digest_Type *d, unsigned char *buf)
+{
+   Digest_Type tmp;
+   unsigned char pad[72];
+   uint64_t bits;
+   size_t n;
+   int i;
 
-      case CURLOPT_USERAGENT:
-	return set_string_opt (ez, opt, nargs);
+   switch (d->type)
+     {
+      case CURL_DIGEST_CRC32C:
+	n = d->crc ^ 0xFFFFFFFFU;
+	buf[0] = (unsigned char) (n >> 24); buf[1] = (unsigned char) (n >> 16);
+	buf[2] = (unsigned char) (n >> 8); buf[3] = (unsigned char) n;
+	return 4;
+
+      case CURL_DIGEST_SHA256:
+	tmp = *d;
+	bits = tmp.count * 8;
+	n = (size_t) (tmp.count & 63);
+	n = (n < 56) ? (56 - n) : (120 - n);
+	memset (pad, 0, sizeof (pad));
+	pad[0] = 0x80;
+	for (i = 0; i < 8; i++)
+	  pad[n + i] = (unsigned char) (bits >> (56 - 8*i));
+	update_sha256 (&tmp, pad, n + 8);
+	for (i = 0; i < 8; i++)
+	  {
+	     buf[4*i] = (unsigned char) (tmp.state[i] >> 24);
+	     buf[4*i+1] = (unsigned char) (tmp.state[i] >> 16);
+	     buf[4*i+2] = (unsigned char) (tmp.state[i] >> 8);
+	     buf[4*i+3] = (unsigned char) tmp.state[i];
+	  }
+	return 32;
+     }
+   return 0;
+}
 
-      case CURLOPT_HTTPHEADER:
-	return set_strlist_opt (ez, opt, nargs, &ez->httpheader);
-	break;
-      case CURLOPT_HTTP200ALIASES:
-	return set_strlist_opt (ez, opt, nargs, &ez->http200aliases);
-	break;
+/*}}}*/
 
-      case CURLOPT_COOKIE:	       /* FIXME: check format */
-	return set_string_opt (ez, opt, nargs);
+/*{{{ Easy_Type Functions */
 
-      case CURLOPT_COOKIEFILE:
-      case CURLOPT_COOKIEJAR:
-	return set_string_opt (ez, opt, nargs);
+/* Drop what is left of a string returned by the read callback */
+static void discard_read_pending (Easy_Type *ez)
+{
+   if (ez->read_pending != NULL)
+     SLbstring_free (ez->read_pending);
+   ez->read_pending = NULL;
+   ez->read_pending_offset = 0;
+}
 
-      case CURLOPT_COOKIESESSION:
-      case CURLOPT_HTTPGET:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+static void init_retry_policy (Easy_Type *ez)
+{
+   ez->retry_max = 0;
+   ez->retry_delay = RETRY_DELAY;
+   ez->retry_max_delay = RETRY_MAX_DELAY;
+   ez->retry_factor = RETRY_FACTOR;
+   ez->retry_jitter = 0.0;
+}
 
-      case CURLOPT_HTTP_VERSION:       /* FIXME: Check values */
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+/* This frees the data referenced by the options of the handle, and returns
+ * the corresponding fields to their initial state.  The libcurl handle must
+ * no longer be using them, i.e., it must have been cleaned up or reset.
+ */
+static void free_easy_options (Easy_Type *ez)
+{
+   char **sp, **spmax;
+   struct curl_slist **slists[8];
+   unsigned int i;
 
-	/* FTP options */
-      case CURLOPT_FTPPORT:
-	return set_string_opt (ez, opt, nargs);
-      case CURLOPT_QUOTE:	       /* FIXME: linked list */
-	return set_strlist_opt (ez, opt, nargs, &ez->quote);
-#ifdef HAVE_CURLOPT_POSTQUOTE
-      case CURLOPT_POSTQUOTE:
-	return set_strlist_opt (ez, opt, nargs, &ez->postquote);
-#endif
-#ifdef HAVE_CURLOPT_PREQUOTE
-      case CURLOPT_PREQUOTE:
-	return set_strlist_opt (ez, opt, nargs, &ez->prequote);
-#endif
-      case CURLOPT_FTPLISTONLY:
-      case CURLOPT_FTPAPPEND:
-      case CURLOPT_FTP_USE_EPRT:
-      case CURLOPT_FTP_USE_EPSV:
-      case CURLOPT_FTP_CREATE_MISSING_DIRS:
-      case CURLOPT_FTP_RESPONSE_TIMEOUT:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+   if (ez->mime_mmt != NULL)
+     SLang_free_mmt (ez->mime_mmt);
+   ez->mime_mmt = NULL;
+   /* The share may only be cleaned up once no handle uses it */
+   if (ez->share_mmt != NULL)
+     SLang_free_mmt (ez->share_mmt);
+   ez->share_mmt = NULL;
 
-#ifdef HAVE_CURLOPT_USE_SSL
-      case CURLOPT_USE_SSL:
-#else
-      case CURLOPT_FTP_SSL: /* deprecated. */
-#endif
-	return set_long_opt (ez, opt, nargs, 0, 0L);   /* FIXME: specific values */
+   if (ez->write_callback != NULL) SLang_free_function (ez->write_callback);
+   if (ez->write_data != NULL) SLang_free_anytype (ez->write_data);
+   ez->write_callback = NULL;
+   ez->write_data = NULL;
+   ez->write_sink = CURL_SINK_CALLBACK;
+   free_byte_buffer (&ez->body);
+   free_file_sink (&ez->file_sink);
+   ez->write_coalesce = 0;
+   free_byte_buffer (&ez->write_pending);
+   ez->header_coalesce = 0;
+   free_byte_buffer (&ez->header_pending);
+   free_framer (&ez->framer);
+   ez->framer.type = CURL_FRAME_NONE;
+   ez->write_digest.type = CURL_DIGEST_NONE;
+   ez->read_digest.type = CURL_DIGEST_NONE;
+   ez->queue_priority = 0;
+   ez->nosignal = 0;
+   init_retry_policy (ez);
 
-#ifdef HAVE_CURLOPT_SOURCE_URL
-      case CURLOPT_SOURCE_URL:
-	return set_string_opt (ez, opt, nargs);
-#endif
-#ifdef HAVE_CURLOPT_SOURCE_USERPWD
-      case CURLOPT_SOURCE_USERPWD:
-	return set_string_opt (ez, opt, nargs);
-#endif
-#ifdef HAVE_CURLOPT_SOURCE_QUOTE
-      case CURLOPT_SOURCE_QUOTE:
-	return set_strlist_opt (ez, opt, nargs, &ez->source_quote);
-#endif
-#ifdef HAVE_CURLOPT_SOURCE_PREQUOTE
-      case CURLOPT_SOURCE_PREQUOTE:
-	return set_strlist_opt (ez, opt, nargs, &ez->source_prequote);
-#endif
-#ifdef HAVE_CURLOPT_SOURCE_POSTQUOTE
-      case CURLOPT_SOURCE_POSTQUOTE:
-	return set_strlist_opt (ez, opt, nargs, &ez->source_postquote);
-#endif
-#ifdef HAVE_CURLOPT_FTP_ACCOUNT
-      case CURLOPT_FTP_ACCOUNT:
-	return set_string_opt (ez, opt, nargs);
-#endif
-	/* protocol options */
-      case CURLOPT_TRANSFERTEXT:
-      case CURLOPT_CRLF:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+   if (ez->read_callback != NULL) SLang_free_function (ez->read_callback);
+   if (ez->read_data != NULL) SLang_free_anytype (ez->read_data);
+   ez->read_callback = NULL;
+   ez->read_data = NULL;
+   free_read_source (&ez->read_source);
+   discard_read_pending (ez);
 
-      case CURLOPT_RANGE:	       /* FIXME: NULL allowed */
-	return set_string_opt (ez, opt, nargs);
+   if (ez->writeheader_callback != NULL) SLang_free_function (ez->writeheader_callback);
+   if (ez->writeheader_data != NULL) SLang_free_anytype (ez->writeheader_data);
+   ez->writeheader_callback = NULL;
+   ez->writeheader_data = NULL;
 
-      case CURLOPT_RESUME_FROM:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   if (ez->progress_callback != NULL) SLang_free_function (ez->progress_callback);
+   if (ez->progress_data != NULL) SLang_free_anytype (ez->progress_data);
+   ez->progress_callback = NULL;
+   ez->progress_data = NULL;
 
-      case CURLOPT_RESUME_FROM_LARGE:  /* FIXME: curl_off_t */
-	break;
+   sp = ez->opt_strings;
+   spmax = sp + NUM_OPT_STRINGS;
+   while (sp < spmax)
+     {
+	if (*sp != NULL)
+	  SLang_free_slstring (*sp);
+	*sp++ = NULL;
+     }
 
-      case CURLOPT_CUSTOMREQUEST:
-	return set_string_opt (ez, opt, nargs);
+   slists[0] = &ez->httpheader;
+   slists[1] = &ez->http200aliases;
+   slists[2] = &ez->quote;
+   slists[3] = &ez->postquote;
+   slists[4] = &ez->prequote;
+   slists[5] = &ez->source_quote;
+   slists[6] = &ez->source_prequote;
+   slists[7] = &ez->source_postquote;
+   for (i = 0; i < 8; i++)
+     {
+	if (*slists[i] != NULL)
+	  curl_slist_free_all (*slists[i]);
+	*slists[i] = NULL;
+     }
 
-      case CURLOPT_FILETIME:
+   if (ez->postfields != NULL) SLbstring_free (ez->postfields);
+   ez->postfields = NULL;
+   ez->postfields_len = -1;
+}
+
+static void free_easy_type (Easy_Type *ez)
+{
+   if (ez == NULL)
+     return;
+
+   if (ez->handle != NULL)
+     curl_easy_cleanup (ez->handle);
+
+   free_easy_options (ez);
+
+   if (ez->url != NULL)
+     SLang_free_slstring (ez->url);
+
+   SLfree ((char *) ez);
+}
+
+static void throw_curl_error (CURLcode err, char *buf)
+{
+   SLang_verror (Curl_Error, "%s: %s", curl_easy_strerror(err), buf);
+}
+
+static int Initialized = 0;
+static void global_init (long *flagsp)
+{
+   long flags = *flagsp;
+
+   /* This cannot be called more than once. */
+   if (Initialized)
+     return;
+
+   flags &= CURL_GLOBAL_ALL;
+
+   if (0 != curl_global_init (flags))
+     {
+	SLang_verror (SL_RunTime_Error, "curl_global_init failed");
+	return;
+     }
+   Initialized = 1;
+}
+
+static void global_cleanup (void)
+{
+   curl_global_cleanup ();
+   Initialized = 0;
+}
+
+static int call_write_callback (SLang_BString_Type *bstr,
+				SLang_Name_Type *write_callback,
+				SLang_Any_Type *write_data)
+{
+   int status;
+
+   if ((-1 == SLang_start_arg_list ())
+       || (-1 == SLang_push_anytype (write_data))
+       || (-1 == SLang_push_bstring (bstr))
+       || (-1 == SLang_end_arg_list ())
+       || (-1 == SLexecute_function (write_callback))
+       || (-1 == SLang_pop_int (&status)))
+     status = -1;
+
+   return status;
+}
+
+static size_t write_function_internal (void *ptr, size_t size, size_t nmemb,
+				       SLang_Name_Type *write_callback,
+				       SLang_Any_Type *write_data)
+{
+   SLang_BString_Type *bstr;
+   int status;
+
+   if (NULL == (bstr = SLbstring_create ((unsigned char *)ptr, size * nmemb)))
+     {
+	return (size_t)0;	       /* error */
+     }
+   status = call_write_callback (bstr, write_callback, write_data);
+   SLbstring_free (bstr);
+
+   if (status != -1)
+     return size * nmemb;
+
+   /* error */
+   return (size_t)0;
+}
+
+/* Like write_function_internal, except that the contents of the buffer
+ * are handed over to the callback without being copied.
+ */
+static int write_byte_buffer_internal (Byte_Buffer_Type *b,
+				       SLang_Name_Type *write_callback,
+				       SLang_Any_Type *write_data)
+{
+   SLang_BString_Type *bstr;
+   int status;
+
+   if (NULL == (bstr = byte_buffer_to_bstring (b)))
+     return -1;
+   status = call_write_callback (bstr, write_callback, write_data);
+   SLbstring_free (bstr);
+   return status;
+}
+
+/* Delivers data to a callback in pieces of at least coalesce bytes.  The
+ * remainder is kept in the pending buffer until flush_coalesced is called.
+ */
+static size_t write_coalesced (unsigned char *bytes, size_t len,
+			       size_t coalesce, Byte_Buffer_Type *pending,
+			       SLang_Name_Type *callback, SLang_Any_Type *data)
+{
+   if (pending->len + len < coalesce)
+     {
+	/* Leave room for the chunk that crosses the threshold */
+	if ((pending->data == NULL)
+	    && (-1 == reserve_byte_buffer (pending, coalesce + CURL_MAX_WRITE_SIZE)))
+	  return 0;
+	if (-1 == append_byte_buffer (pending, bytes, len))
+	  return 0;
+	return len;
+     }
+
+   if (pending->len == 0)
+     {
+	/* Avoid a copy */
+	if (len != write_function_internal (bytes, 1, len, callback, data))
+	  return 0;
+	return len;
+     }
+
+   if (-1 == append_byte_buffer (pending, bytes, len))
+     return 0;
+
+   if (-1 == write_byte_buffer_internal (pending, callback, data))
+     return 0;
+
+   return len;
+}
+
+static int flush_coalesced (Byte_Buffer_Type *pending,
+			    SLang_Name_Type *callback, SLang_Any_Type *data)
+{
+   if (pending->len == 0)
+     return 0;
+
+   if (-1 == write_byte_buffer_internal (pending, callback, data))
+     return -1;
+   return 0;
+}
+
+/* Passes the records split off by the framer to the write callback as an
+ * array of strings, or binary strings for CURL_FRAME_LENGTH32.
+ */
+static int write_framer_records (Framer_Type *fr,
+				 SLang_Name_Type *write_callback,
+				 SLang_Any_Type *write_data)
+{
+   SLang_Array_Type *at;
+   SLindex_Type num = fr->num_records;
+   int status;
+
+   if (num == 0)
+     return 0;
+
+   at = SLang_create_array ((fr->type == CURL_FRAME_LENGTH32) ? SLANG_BSTRING_TYPE : SLANG_STRING_TYPE,
+			    0, NULL, &num, 1);
+   if (at == NULL)
+     return -1;
+
+   /* The array takes over the records */
+   memcpy ((char *) at->data, (char *) fr->records, num * sizeof (VOID_STAR));
+   fr->num_records = 0;
+
+   if ((-1 == SLang_start_arg_list ())
+       || (-1 == SLang_push_anytype (write_data))
+       || (-1 == SLang_push_array (at, 1))
+       || (-1 == SLang_end_arg_list ())
+       || (-1 == SLexecute_function (write_callback))
+       || (-1 == SLang_pop_int (&status)))
+     status = -1;
+
+   return status;
+}
+
+static size_t write_framed (Easy_Type *ez, unsigned char *bytes, size_t len)
+{
+   Framer_Type *fr = &ez->framer;
+
+   if (fr->buf.len + len < ez->write_coalesce)
+     {
+	if (-1 == append_byte_buffer (&fr->buf, bytes, len))
+	  return 0;
+	return len;
+     }
+
+   if ((-1 == framer_push_bytes (fr, bytes, len, 0))
+       || (-1 == write_framer_records (fr, ez->write_callback, ez->write_data)))
+     return 0;
+
+   return len;
+}
+
+/* Returns the expected size of the body, or -1 if unknown */
+static curl_off_t get_content_length (CURL *handle)
+{
+#ifdef HAVE_CURLINFO_CONTENT_LENGTH_DOWNLOAD_T
+   curl_off_t len;
+
+   if (CURLE_OK != curl_easy_getinfo (handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len))
+     return -1;
+   return len;
+#else
+   double len;
+
+   if (CURLE_OK != curl_easy_getinfo (handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &len))
+     return -1;
+   return (curl_off_t) len;
+#endif
+}
+
+#define MAX_BODY_PRESIZE ((curl_off_t) 0x10000000)
+static size_t write_buffer_sink (Easy_Type *ez, unsigned char *bytes, size_t len)
+{
+   Byte_Buffer_Type *b = &ez->body;
+
+   if (b->len == 0)
+     {
+	/* First chunk of the body: size the buffer once if possible.  Do
+	 * not trust a huge Content-Length enough to allocate it up front.
+	 */
+	curl_off_t clen = get_content_length (ez->handle);
+	if ((clen > 0) && (clen <= MAX_BODY_PRESIZE)
+	    && (-1 == reserve_byte_buffer (b, (size_t) clen)))
+	  return 0;
+     }
+
+   if (-1 == append_byte_buffer (b, bytes, len))
+     return 0;
+
+   return len;
+}
+
+static size_t write_file_sink (Easy_Type *ez, unsigned char *bytes, size_t len)
+{
+   File_Sink_Type *fs = &ez->file_sink;
+   Byte_Buffer_Type *stage = &fs->stage;
+
+   if (fs->fd == -1)
+     return 0;
+
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+   if (fs->seekable && (fs->offset == fs->start_offset) && (stage->len == 0))
+     {
+	/* Reserve the space up front to avoid fragmentation.  This is only
+	 * advisory, so failures are ignored.
+	 */
+	curl_off_t clen = get_content_length (ez->handle);
+	struct stat st;
+
+	if ((clen > 0) && (0 == fstat (fs->fd, &st))
+	    && ((curl_off_t) st.st_size < fs->start_offset + clen)
+	    && (0 == posix_fallocate (fs->fd, (off_t) fs->start_offset, (off_t) clen)))
+	  fs->reserved_from = (curl_off_t) st.st_size;
+     }
+#endif
+
+   if (fs->stage_size == 0)
+     {
+	if (-1 == write_file_sink_fd (fs, bytes, len))
+	  return 0;
+	return len;
+     }
+
+   if ((stage->len + len > fs->stage_size)
+       && (-1 == flush_file_sink (fs)))
+     return 0;
+
+   if (len >= fs->stage_size)
+     {
+	if (-1 == write_file_sink_fd (fs, bytes, len))
+	  return 0;
+	return len;
+     }
+
+   if ((stage->data == NULL)
+       && (-1 == reserve_byte_buffer (stage, fs->stage_size)))
+     return 0;
+
+   if (-1 == append_byte_buffer (stage, bytes, len))
+     return 0;
+   return len;
+}
+
+/* slang: Int_Type write_function (writedata, string);
+ * return values: success: 0, error: -1
+ */
+static size_t write_function (void *ptr, size_t size, size_t nmemb, void *stream)
+{
+   Easy_Type *ez;
+
+   ez = (Easy_Type *) stream;
+   if (ez->write_digest.type != CURL_DIGEST_NONE)
+     update_digest (&ez->write_digest, (unsigned char *)ptr, size * nmemb);
+
+   switch (ez->write_sink)
+     {
+      case CURL_SINK_BUFFER:
+	return write_buffer_sink (ez, (unsigned char *)ptr, size * nmemb);
+
+      case CURL_SINK_FILE:
+	return write_file_sink (ez, (unsigned char *)ptr, size * nmemb);
+
+      default:
+	break;
+     }
+
+   if (ez->framer.type != CURL_FRAME_NONE)
+     return write_framed (ez, (unsigned char *)ptr, size * nmemb);
+
+   if (ez->write_coalesce)
+     {
+	if (size * nmemb != write_coalesced ((unsigned char *)ptr, size * nmemb, ez->write_coalesce,
+					     &ez->write_pending, ez->write_callback, ez->write_data))
+	  return 0;
+	return size * nmemb;
+     }
+   return write_function_internal (ptr, size, nmemb, ez->write_callback, ez->write_data);
+}
+
+/* These are called before and after each transfer to prepare and finalize
+ * the native sinks and digests.
+ */
+static int start_transfer (Easy_Type *ez)
+{
+   ez->body.len = 0;
+   ez->write_pending.len = 0;
+   ez->header_pending.len = 0;
+   reset_framer (&ez->framer);
+   init_digest (&ez->write_digest);
+   init_digest (&ez->read_digest);
+   ez->read_source.offset = 0;
+   discard_read_pending (ez);
+   if (ez->write_sink == CURL_SINK_FILE)
+     return open_file_sink (&ez->file_sink);
+   return 0;
+}
+
+static int end_transfer (Easy_Type *ez, int ok)
+{
+   int status = 0;
+
+   if (ok)
+     {
+	/* Deliver whatever the coalescing held back */
+	if (((ez->header_pending.len)
+	     && (-1 == flush_coalesced (&ez->header_pending, ez->writeheader_callback, ez->writeheader_data)))
+	    || ((ez->write_pending.len)
+		&& (-1 == flush_coalesced (&ez->write_pending, ez->write_callback, ez->write_data)))
+	    || ((ez->framer.type != CURL_FRAME_NONE)
+		&& ((-1 == framer_push_bytes (&ez->framer, NULL, 0, 1))
+		    || (-1 == write_framer_records (&ez->framer, ez->write_callback, ez->write_data)))))
+	  {
+	     ok = 0;
+	     status = -1;
+	  }
+     }
+   ez->write_pending.len = 0;
+   ez->header_pending.len = 0;
+   reset_framer (&ez->framer);
+
+   if ((ez->write_sink == CURL_SINK_FILE)
+       && (-1 == close_file_sink (&ez->file_sink, ok, ez->errbuf)))
+     status = -1;
+
+   return status;
+}
+
+static size_t write_header_function (void *ptr, size_t size, size_t nmemb, void *stream)
+{
+   Easy_Type *ez;
+
+   ez = (Easy_Type *) stream;
+   if (ez->header_coalesce)
+     {
+	if (size * nmemb != write_coalesced ((unsigned char *)ptr, size * nmemb, ez->header_coalesce,
+					     &ez->header_pending, ez->writeheader_callback, ez->writeheader_data))
+	  return 0;
+	return size * nmemb;
+     }
+   return write_function_internal (ptr, size, nmemb, ez->writeheader_callback, ez->writeheader_data);
+}
+
+static int progress_function (void *clientp, double dltotal, double dlnow, double ultotal, double ulnow)
+{
+   Easy_Type *ez;
+   int status;
+
+   ez = (Easy_Type *)clientp;
+   if ((-1 == SLang_start_arg_list ())
+       || (-1 == SLang_push_anytype (ez->progress_data))
+       || (-1 == SLang_push_double (dltotal))
+       || (-1 == SLang_push_double (dlnow))
+       || (-1 == SLang_push_double (ultotal))
+       || (-1 == SLang_push_double (ulnow))
+       || (-1 == SLang_end_arg_list ())
+       || (-1 == SLexecute_function (ez->progress_callback))
+       || (-1 == SLang_pop_int (&status)))
+     status = -1;
+
+   return status;
+}
+
+/* slang: Bstring read_function (Object, num_bytes)
+ *
+ *   If NULL returned, operation will be aborted.
+ */
+static size_t read_function (void *ptr, size_t size, size_t nmemb, void *stream)
+{
+   Easy_Type *ez;
+   SLang_BString_Type *bstr;
+   SLstrlen_Type bytes_read, bytes_requested;
+   unsigned char *bytes;
+
+   bytes_requested = (unsigned int) (size * nmemb);
+
+   ez = (Easy_Type *) stream;
+   if (ez->read_source.type != READ_SOURCE_NONE)
+     {
+	long n = read_from_source (&ez->read_source, (unsigned char *) ptr, bytes_requested);
+	if (n < 0)
+	  return CURL_READFUNC_ABORT;
+	if (ez->read_digest.type != CURL_DIGEST_NONE)
+	  update_digest (&ez->read_digest, (unsigned char *) ptr, (size_t) n);
+	return (size_t) n;
+     }
+
+   if (ez->read_pending != NULL)
+     {
+	/* Use what is left over from the last callback before calling it again */
+	bstr = ez->read_pending;
+	if (NULL == (bytes = SLbstring_get_pointer (bstr, &bytes_read)))
+	  return CURL_READFUNC_ABORT;
+	bytes += ez->read_pending_offset;
+	bytes_read -= ez->read_pending_offset;
+     }
+   else
+     {
+	if ((-1 == SLang_start_arg_list ())
+	    || (-1 == ((ez->read_data == NULL)
+		       ? SLang_push_mmt (ez->mmt)
+		       : SLang_push_anytype (ez->read_data)))
+	    || (-1 == SLang_push_long (bytes_requested))
+	    || (-1 == SLang_end_arg_list ())
+	    || (-1 == SLexecute_function (ez->read_callback)))
+	  {
+	     return CURL_READFUNC_ABORT;
+	  }
+
+	if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+	  {
+	     (void) SLang_pop_null ();
+	     return CURL_READFUNC_ABORT;
+	  }
+
+	if (-1 == SLang_pop_bstring (&bstr))
+	  {
+	     return CURL_READFUNC_ABORT;
+	  }
+
+	if (NULL == (bytes = SLbstring_get_pointer (bstr, &bytes_read)))
+	  {
+	     SLbstring_free (bstr);
+	     return CURL_READFUNC_ABORT;
+	  }
+	ez->read_pending = bstr;
+	ez->read_pending_offset = 0;
+     }
+
+   if (bytes_read > bytes_requested)
+     {
+	/* Keep the surplus for the next call */
+	ez->read_pending_offset += bytes_requested;
+	bytes_read = bytes_requested;
+	bstr = NULL;
+     }
+   else
+     ez->read_pending = NULL;
+
+   memcpy ((char *) ptr, bytes, bytes_read);
+   if (ez->read_digest.type != CURL_DIGEST_NONE)
+     update_digest (&ez->read_digest, (unsigned char *) ptr, bytes_read);
+
+   /* The string may only be freed once its bytes have been copied */
+   if (bstr != NULL)
+     SLbstring_free (bstr);
+
+   return bytes_read;
+}
+
+#ifdef HAVE_CURLOPT_SEEKFUNCTION
+/* This is used only for the sources set up by CURLOPT_READDATA so that
+ * libcurl may rewind them, e.g., when following a redirect.
+ */
+static int seek_function (void *clientp, curl_off_t offset, int origin)
+{
+   Easy_Type *ez = (Easy_Type *) clientp;
+   Read_Source_Type *rs = &ez->read_source;
+
+   if (rs->type == READ_SOURCE_NONE)
+     return CURL_SEEKFUNC_CANTSEEK;
+
+   if (origin == SEEK_CUR)
+     offset += rs->offset;
+   else if (origin == SEEK_END)
+     {
+	if (rs->size < 0)
+	  return CURL_SEEKFUNC_CANTSEEK;
+	offset += rs->size;
+     }
+
+   if (-1 == seek_read_source (rs, offset))
+     return CURL_SEEKFUNC_CANTSEEK;
+
+   return CURL_SEEKFUNC_OK;
+}
+#endif
+
+static int check_handle (Easy_Type *ez, unsigned int flags)
+{
+   if ((ez == NULL) || (ez->handle == NULL))
+     {
+	SLang_verror (SL_RunTime_Error, "Curl_Type object has already been closed and may not be reused");
+	return -1;
+     }
+   if (ez->flags & ASYNC_RUNNING)
+     {
+	SLang_verror (SL_RunTime_Error, "Curl_Type object may not be used until its asynchronous transfer has been collected");
+	return -1;
+     }
+   /* While a multi is being processed, its flags apply to its handles */
+   if ((ez->flags & flags)
+       || ((ez->multi != NULL) && (ez->multi->flags & flags)))
+     {
+	SLang_verror (SL_RunTime_Error, "It is illegal to call this function while curl_perform is running");
+	return -1;
+     }
+
+   return 0;
+}
+
+static SLang_MMT_Type *pop_easy_type (Easy_Type **ezp, unsigned int flags)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+
+   if (NULL == (mmt = SLang_pop_mmt (Easy_Type_Id)))
+     {
+	*ezp = NULL;
+	return NULL;
+     }
+
+   ez = (Easy_Type *)SLang_object_from_mmt (mmt);
+   if (-1 == check_handle (ez, flags))
+     {
+	SLang_free_mmt (mmt);
+	return NULL;
+     }
+   *ezp = ez;
+   return mmt;
+}
+
+static int set_long_opt (Easy_Type *ez, CURLoption opt, int nargs, int use_def, long val)
+{
+   CURLcode status;
+
+   if ((nargs > 1)
+       || ((nargs == 0) && (use_def == 0)))
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL option");
+	return -1;
+     }
+
+   if (nargs && (-1 == SLang_pop_long (&val)))
+     return -1;
+
+   status = curl_easy_setopt (ez->handle, opt, val);
+   if (status == CURLE_OK)
+     return 0;
+
+   throw_curl_error (status, ez->errbuf);
+   return -1;
+}
+
+/* The value is recorded so that curl_perform_async can restore it */
+static int set_nosignal_opt (Easy_Type *ez, int nargs)
+{
+   long val = 1L;
+
+   if (nargs > 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL option");
+	return -1;
+     }
+   if (nargs && (-1 == SLang_pop_long (&val)))
+     return -1;
+
+   if (-1 == set_long_opt (ez, CURLOPT_NOSIGNAL, 0, 1, val))
+     return -1;
+   ez->nosignal = val;
+   return 0;
+}
+
+typedef size_t (*CFUNC_Type)(void *, size_t, size_t, void *);
+
+static int set_function_opt (Easy_Type *ez, CURLoption opt, CURLoption data_opt, int nargs,
+			     SLang_Name_Type **funcp, SLang_Any_Type **datap,
+			     CFUNC_Type callback)
+{
+   SLang_Any_Type *data;
+   SLang_Name_Type *func;
+
+   if (nargs != 2)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting two arguments for this option");
+	return -1;
+     }
+
+   if (NULL == (func = SLang_pop_function ()))
+     return -1;
+
+   if (-1 == SLang_pop_anytype (&data))
+     {
+	SLang_free_function (func);
+	return -1;
+     }
+
+   if ((CURLE_OK != curl_easy_setopt (ez->handle, opt, callback))
+       || (CURLE_OK != curl_easy_setopt (ez->handle, data_opt, ez)))
+     {
+	SLang_free_function (func);
+	SLang_free_anytype (data);
+	return -1;
+     }
+
+   if (NULL != *funcp)
+     SLang_free_function (*funcp);
+   *funcp = func;
+
+   if (NULL != *datap)
+     SLang_free_anytype (*datap);
+   *datap = data;
+
+   return 0;
+}
+
+/* Pops the (path|fd [,staging_size]) arguments of CURL_SINK_FILE */
+static int pop_file_sink_args (File_Sink_Type *fs, int nargs)
+{
+   init_file_sink (fs);
+
+   if ((nargs < 1) || (nargs > 2))
+     {
+	SLang_verror (SL_INVALID_PARM, "CURL_SINK_FILE requires a filename or a descriptor, and an optional staging buffer size");
+	return -1;
+     }
+
+   if (SLang_peek_at_stack () == SLANG_STRING_TYPE)
+     {
+	if (-1 == SLang_pop_slstring (&fs->path))
+	  return -1;
+     }
+   else
+     {
+	SLFile_FD_Type *f;
+	int fd;
+
+	if (-1 == SLfile_pop_fd (&f))
+	  return -1;
+
+	if ((-1 == SLfile_get_fd (f, &fd))
+	    || (-1 == (fs->user_fd = dup (fd))))
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Invalid file descriptor for CURL_SINK_FILE");
+	     SLfile_free_fd (f);
+	     return -1;
+	  }
+	SLfile_free_fd (f);
+     }
+
+   if (nargs == 2)
+     {
+	long size;
+
+	if ((-1 == SLang_pop_long (&size))
+	    || (size < 0))
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Expecting a non-negative staging buffer size");
+	     free_file_sink (fs);
+	     return -1;
+	  }
+	fs->stage_size = (size_t) size;
+     }
+   return 0;
+}
+
+/* Handles CURLOPT_WRITEFUNCTION, which takes either a callback and its
+ * client data, or one of the CURL_SINK_* values followed by any arguments
+ * that the sink requires.
+ */
+static int set_write_function_opt (Easy_Type *ez, int nargs)
+{
+   File_Sink_Type fs;
+   int sink;
+
+   if ((nargs < 1) || (SLang_peek_at_stack () != SLANG_INT_TYPE))
+     {
+	if (-1 == set_function_opt (ez, CURLOPT_WRITEFUNCTION, CURLOPT_WRITEDATA, nargs,
+				    &ez->write_callback, &ez->write_data, write_function))
+	  return -1;
+	free_file_sink (&ez->file_sink);
+	ez->write_sink = CURL_SINK_CALLBACK;
+	return 0;
+     }
+
+   if (-1 == SLang_pop_int (&sink))
+     return -1;
+   nargs--;
+
+   init_file_sink (&fs);
+   switch (sink)
+     {
+      case CURL_SINK_BUFFER:
+	if (nargs != 0)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "CURL_SINK_BUFFER does not take any arguments");
+	     return -1;
+	  }
+	break;
+
+      case CURL_SINK_FILE:
+	if (-1 == pop_file_sink_args (&fs, nargs))
+	  return -1;
+	break;
+
+      default:
+	SLang_verror (SL_INVALID_PARM, "Unknown or unsupported CURL_SINK value");
+	return -1;
+     }
+
+   if ((CURLE_OK != curl_easy_setopt (ez->handle, CURLOPT_WRITEFUNCTION, write_function))
+       || (CURLE_OK != curl_easy_setopt (ez->handle, CURLOPT_WRITEDATA, ez)))
+     {
+	SLang_verror (Curl_Error, "Unable to set the write function");
+	free_file_sink (&fs);
+	return -1;
+     }
+
+   if (ez->write_callback != NULL)
+     {
+	SLang_free_function (ez->write_callback);
+	ez->write_callback = NULL;
+     }
+   if (ez->write_data != NULL)
+     {
+	SLang_free_anytype (ez->write_data);
+	ez->write_data = NULL;
+     }
+   free_file_sink (&ez->file_sink);
+   ez->file_sink = fs;
+   ez->body.len = 0;
+   ez->write_sink = sink;
+   return 0;
+}
+
+/* Handles CURLOPT_READDATA, which takes a filename, a descriptor, or a
+ * binary string from which the data are uploaded without a callback.
+ */
+static int set_read_data_opt (Easy_Type *ez, int nargs)
+{
+   Read_Source_Type rs;
+   CURLcode status;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "CURLOPT_READDATA requires a filename, a descriptor, or a binary string");
+	return -1;
+     }
+
+   init_read_source (&rs);
+
+   switch (SLang_peek_at_stack ())
+     {
+      case SLANG_BSTRING_TYPE:
+	  {
+	     SLstrlen_Type len;
+
+	     if (-1 == SLang_pop_bstring (&rs.bstr))
+	       return -1;
+	     if (NULL == (rs.data = SLbstring_get_pointer (rs.bstr, &len)))
+	       {
+		  free_read_source (&rs);
+		  return -1;
+	       }
+	     rs.type = READ_SOURCE_MEMORY;
+	     rs.size = (curl_off_t) len;
+	  }
+	break;
+
+      case SLANG_STRING_TYPE:
+	  {
+	     char *file;
+	     int fd;
+
+	     if (-1 == SLang_pop_slstring (&file))
+	       return -1;
+	     while (-1 == (fd = open (file, O_RDONLY)))
+	       {
+		  if (errno == EINTR)
+		    continue;
+		  SLang_verror (SL_Open_Error, "Unable to open %s: %s", file, strerror (errno));
+		  SLang_free_slstring (file);
+		  return -1;
+	       }
+	     SLang_free_slstring (file);
+	     (void) open_fd_read_source (&rs, fd, 1);
+	  }
+	break;
+
+      default:
+	  {
+	     SLFile_FD_Type *f;
+	     int fd;
+
+	     if (-1 == SLfile_pop_fd (&f))
+	       return -1;
+	     if ((-1 == SLfile_get_fd (f, &fd))
+		 || (-1 == (fd = dup (fd))))
+	       {
+		  SLang_verror (SL_INVALID_PARM, "Invalid file descriptor for CURLOPT_READDATA");
+		  SLfile_free_fd (f);
+		  return -1;
+	       }
+	     SLfile_free_fd (f);
+	     (void) open_fd_read_source (&rs, fd, 0);
+	  }
+	break;
+     }
+
+   if ((CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_READFUNCTION, read_function)))
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_READDATA, ez)))
+#ifdef HAVE_CURLOPT_SEEKFUNCTION
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_SEEKFUNCTION, seek_function)))
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_SEEKDATA, ez)))
+#endif
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_INFILESIZE_LARGE, rs.size))))
+     {
+	throw_curl_error (status, ez->errbuf);
+	free_read_source (&rs);
+	return -1;
+     }
+   discard_read_pending (ez);
+
+   if (ez->read_callback != NULL)
+     {
+	SLang_free_function (ez->read_callback);
+	ez->read_callback = NULL;
+     }
+   if (ez->read_data != NULL)
+     {
+	SLang_free_anytype (ez->read_data);
+	ez->read_data = NULL;
+     }
+   free_read_source (&ez->read_source);
+   ez->read_source = rs;
+   return 0;
+}
+
+static int set_string_opt_internal (Easy_Type *ez, CURLoption opt, char *str)
+{
+   char *old;
+   CURLcode status;
+   int indx;
+
+   indx = opt - (int)CURLOPTTYPE_OBJECTPOINT;
+   if ((indx < 0) || (indx >= (int)NUM_OPT_STRINGS))
+     {
+	SLang_verror (SL_Internal_Error, "Unexpected Curl option value %d", opt);
+	return -1;
+     }
+   old = ez->opt_strings[indx];
+
+   if (old == str)
+     return 0;
+
+   if ((str != NULL)
+       && (NULL == (str = SLang_create_slstring (str))))
+     return -1;
+   status = curl_easy_setopt (ez->handle, opt, str);
+   if (status != CURLE_OK)
+     {
+	throw_curl_error (status, ez->errbuf);
+	if (str != NULL) SLang_free_slstring (str);
+	return -1;
+     }
+   ez->opt_strings[indx] = str;
+   SLang_free_slstring (old);
+
+   if (opt == CURLOPT_URL)
+     {
+	if ((str != NULL)
+	    && (NULL == (str = SLang_create_slstring (str))))
+	  return -1;
+	SLang_free_slstring (ez->url);
+	ez->url = str;
+     }
+   return 0;
+}
+
+static int set_string_opt (Easy_Type *ez, CURLoption opt, int nargs)
+{
+   char *str;
+   int ret;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single string argument");
+	return -1;
+     }
+   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+     {
+	SLang_pop_null ();
+	str = NULL;
+     }
+   else if (-1 == SLang_pop_slstring (&str))
+     return -1;
+
+   ret = set_string_opt_internal (ez, opt, str);
+   if (str != NULL) SLang_free_slstring (str);
+   return ret;
+}
+
+/* CURLOPT_POSTFIELDS takes a string, or a binary string that is passed to
+ * libcurl without being copied.  The string is referenced by the object
+ * until the option is changed.
+ */
+static int set_postfields_opt (Easy_Type *ez, int nargs)
+{
+   SLang_BString_Type *bstr;
+   unsigned char *data;
+   SLstrlen_Type len;
+   CURLcode status;
+   char *str;
+
+   if ((nargs != 1) || (SLang_peek_at_stack () != SLANG_BSTRING_TYPE))
+     {
+	if (-1 == set_string_opt (ez, CURLOPT_POSTFIELDS, nargs))
+	  return -1;
+
+	str = ez->opt_strings[CURLOPT_POSTFIELDS - CURLOPTTYPE_OBJECTPOINT];
+	ez->postfields_len = (str == NULL) ? -1 : (curl_off_t) strlen (str);
+	(void) curl_easy_setopt (ez->handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) -1);
+	if (ez->postfields != NULL)
+	  {
+	     SLbstring_free (ez->postfields);
+	     ez->postfields = NULL;
+	  }
+	return 0;
+     }
+
+   if (-1 == SLang_pop_bstring (&bstr))
+     return -1;
+
+   if (NULL == (data = SLbstring_get_pointer (bstr, &len)))
+     {
+	SLbstring_free (bstr);
+	return -1;
+     }
+
+   if ((CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) len)))
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_POSTFIELDS, (char *) data))))
+     {
+	throw_curl_error (status, ez->errbuf);
+	SLbstring_free (bstr);
+	return -1;
+     }
+
+   /* libcurl no longer references any previous string value */
+   str = ez->opt_strings[CURLOPT_POSTFIELDS - CURLOPTTYPE_OBJECTPOINT];
+   ez->opt_strings[CURLOPT_POSTFIELDS - CURLOPTTYPE_OBJECTPOINT] = NULL;
+   SLang_free_slstring (str);
+
+   if (ez->postfields != NULL)
+     SLbstring_free (ez->postfields);
+   ez->postfields = bstr;
+   ez->postfields_len = (curl_off_t) len;
+   return 0;
+}
+
+/* Handles the curl_off_t valued options */
+static int set_off_t_opt (Easy_Type *ez, CURLoption opt, int nargs)
+{
+   CURLcode status;
+   double val;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL option");
+	return -1;
+     }
+
+   /* A double is used since a long may not be able to represent a curl_off_t */
+   if (-1 == SLang_pop_double (&val))
+     return -1;
+
+   status = curl_easy_setopt (ez->handle, opt, (curl_off_t) val);
+   if (status == CURLE_OK)
+     return 0;
+
+   throw_curl_error (status, ez->errbuf);
+   return -1;
+}
+
+/* Handles CURLOPT_POSTFIELDSIZE and CURLOPT_POSTFIELDSIZE_LARGE */
+static int set_postfieldsize_opt (Easy_Type *ez, CURLoption opt, int nargs)
+{
+   CURLcode status;
+   double size;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL option");
+	return -1;
+     }
+
+   /* A double is used since a long may not be able to represent a curl_off_t */
+   if (-1 == SLang_pop_double (&size))
+     return -1;
+
+   /* libcurl would read past the end of the data otherwise */
+   if ((ez->postfields_len >= 0) && (size > (double) ez->postfields_len))
+     {
+	SLang_verror (SL_INVALID_PARM, "The size exceeds that of the CURLOPT_POSTFIELDS data");
+	return -1;
+     }
+
+   if (opt == CURLOPT_POSTFIELDSIZE)
+     status = curl_easy_setopt (ez->handle, opt, (long) size);
+   else
+     status = curl_easy_setopt (ez->handle, opt, (curl_off_t) size);
+
+   if (status == CURLE_OK)
+     return 0;
+
+   throw_curl_error (status, ez->errbuf);
+   return -1;
+}
+
+#ifdef HAVE_CURLOPT_MIMEPOST
+/* The Curl_Mime_Type object is referenced by the Curl_Type object for as
+ * long as libcurl may use it.
+ */
+static int set_mimepost_opt (Easy_Type *ez, int nargs)
+{
+   SLang_MMT_Type *mmt = NULL;
+   Mime_Type *mt = NULL;
+   CURLcode status;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "CURLOPT_MIMEPOST requires a Curl_Mime_Type object");
+	return -1;
+     }
+
+   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+     (void) SLang_pop_null ();
+   else
+     {
+	if (NULL == (mmt = SLang_pop_mmt (Mime_Type_Id)))
+	  return -1;
+	mt = (Mime_Type *) SLang_object_from_mmt (mmt);
+	if (mt->handle != ez->handle)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "The Curl_Mime_Type object was created for a different Curl_Type object");
+	     SLang_free_mmt (mmt);
+	     return -1;
+	  }
+     }
+
+   status = curl_easy_setopt (ez->handle, CURLOPT_MIMEPOST, (mt == NULL) ? NULL : mt->mime);
+   if (status != CURLE_OK)
+     {
+	throw_curl_error (status, ez->errbuf);
+	if (mmt != NULL) SLang_free_mmt (mmt);
+	return -1;
+     }
+
+   if (ez->mime_mmt != NULL)
+     SLang_free_mmt (ez->mime_mmt);
+   ez->mime_mmt = mmt;
+   return 0;
+}
+#endif
+
+#ifdef HAVE_CURLOPT_SHARE
+/* The Curl_Type object holds a reference to the Curl_Share_Type object
+ * since the share must outlive the handles that use it.
+ */
+static int set_share_opt (Easy_Type *ez, int nargs)
+{
+   SLang_MMT_Type *mmt = NULL;
+   Share_Type *sh = NULL;
+   CURLcode status;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "CURLOPT_SHARE requires a Curl_Share_Type object");
+	return -1;
+     }
+
+   switch (SLang_peek_at_stack ())
+     {
+      case SLANG_NULL_TYPE:
+	(void) SLang_pop_null ();
+	break;
+
+      case SLANG_INT_TYPE:
+	/* CURLOPT_DNS_USE_GLOBAL_CACHE: obsolete and not encouraged */
+	return SLdo_pop ();
+
+      default:
+	if (NULL == (mmt = SLang_pop_mmt (Share_Type_Id)))
+	  return -1;
+	sh = (Share_Type *) SLang_object_from_mmt (mmt);
+	break;
+     }
+
+   status = curl_easy_setopt (ez->handle, CURLOPT_SHARE, (sh == NULL) ? NULL : sh->shandle);
+   if (status != CURLE_OK)
+     {
+	throw_curl_error (status, ez->errbuf);
+	if (mmt != NULL) SLang_free_mmt (mmt);
+	return -1;
+     }
+
+   if (ez->share_mmt != NULL)
+     SLang_free_mmt (ez->share_mmt);
+   ez->share_mmt = mmt;
+   return 0;
+}
+#endif
+
+/* Make sure that the requested HTTP version is known to the library, and
+ * that the library was built with support for it.
+ */
+static int set_http_version_opt (Easy_Type *ez, int nargs)
+{
+   curl_version_info_data *info;
+   long version;
+   int feature = 0;
+   CURLcode status;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL option");
+	return -1;
+     }
+   if (-1 == SLang_pop_long (&version))
+     return -1;
+
+   switch (version)
+     {
+      case CURL_HTTP_VERSION_NONE:
+      case CURL_HTTP_VERSION_1_0:
+      case CURL_HTTP_VERSION_1_1:
+	break;
+
+#ifdef HAVE_CURL_HTTP_VERSION_2_0
+      case CURL_HTTP_VERSION_2_0:
+# ifdef HAVE_CURL_HTTP_VERSION_2TLS
+      case CURL_HTTP_VERSION_2TLS:
+# endif
+# ifdef HAVE_CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+      case CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE:
+# endif
+	feature = CURL_VERSION_HTTP2;
+	break;
+#endif
+
+#ifdef HAVE_CURL_HTTP_VERSION_3
+      case CURL_HTTP_VERSION_3:
+	feature = CURL_VERSION_HTTP3;
+	break;
+#endif
+
+      default:
+	SLang_verror (SL_INVALID_PARM, "Unknown or unsupported CURL_HTTP_VERSION value");
+	return -1;
+     }
+
+   if (feature != 0)
+     {
+	info = curl_version_info (CURLVERSION_NOW);
+	if ((info == NULL) || (0 == (info->features & feature)))
+	  {
+	     SLang_verror (SL_NotImplemented_Error, "The cURL library does not support HTTP/%s",
+			   (feature == CURL_VERSION_HTTP2) ? "2" : "3");
+	     return -1;
+	  }
+     }
+
+   status = curl_easy_setopt (ez->handle, CURLOPT_HTTP_VERSION, version);
+   if (status == CURLE_OK)
+     return 0;
+
+   throw_curl_error (status, ez->errbuf);
+   return -1;
+}
+
+static int set_strlist_opt (Easy_Type *ez, CURLoption opt, int nargs,
+			    struct curl_slist **slistp)
+{
+   struct curl_slist *slist = NULL;
+   CURLcode status;
+
+   if (nargs > 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "This option requires an array of strings");
+	return -1;
+     }
+
+   if (nargs == 1)
+     {
+	SLang_Array_Type *at;
+	char **sp, **spmax;
+
+	if (-1 == SLang_pop_array_of_type (&at, SLANG_STRING_TYPE))
+	  return -1;
+	sp = (char **)at->data;
+	spmax = sp + at->num_elements;
+
+	while (sp < spmax)
+	  {
+	     if (*sp != NULL)
+	       {
+		  struct curl_slist *olist = slist;
+		  if (NULL == (slist = curl_slist_append (olist, *sp)))
+		    {
+		       SLang_verror (Curl_Error, "Error in building a cURL list");
+		       curl_slist_free_all (olist);
+		       SLang_free_array (at);
+		       return -1;
+		    }
+	       }
+	     sp++;
+	  }
+	SLang_free_array (at);
+     }
+
+   if (*slistp != NULL)
+     {
+	curl_slist_free_all (*slistp);
+	*slistp = NULL;
+     }
+
+   status = curl_easy_setopt (ez->handle, opt, slist);
+
+   if (status != CURLE_OK)
+     {
+	if (slist != NULL)
+	  curl_slist_free_all (slist);
+	throw_curl_error (status, ez->errbuf);
+	return -1;
+     }
+   *slistp = slist;
+   return 0;
+}
+
+static int do_setopt (Easy_Type *ez, CURLoption opt, int nargs)
+{
+   switch (opt)
+     {
+	/* behavior options (long arg) */
+      case CURLOPT_VERBOSE:
+      case CURLOPT_HEADER:
+      case CURLOPT_NOPROGRESS:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+      case CURLOPT_NOSIGNAL:	       /* May not want to support this */
+	return set_nosignal_opt (ez, nargs);
+
+	/* Callback Options */
+      case CURLOPT_WRITEFUNCTION:
+	return set_write_function_opt (ez, nargs);
+
+      case CURLOPT_READFUNCTION:
+	if (-1 == set_function_opt (ez, opt, CURLOPT_READDATA, nargs, &ez->read_callback, &ez->read_data, read_function))
+	  return -1;
+	free_read_source (&ez->read_source);
+	discard_read_pending (ez);     /* left over from the previous source */
+	return 0;
+
+#ifdef HAVE_CURLOPT_SEEKFUNCTION
+      case CURLOPT_SEEKFUNCTION:
+#else
+      case CURLOPT_IOCTLFUNCTION:
+#endif
+	break;
+
+#ifdef HAVE_CURLOPT_XFERINFOFUNCTION
+      case CURLOPT_XFERINFOFUNCTION:
+#else
+      case CURLOPT_PROGRESSFUNCTION:
+#endif
+	(void) curl_easy_setopt (ez->handle, CURLOPT_NOPROGRESS, 0);
+	return set_function_opt (ez, opt, CURLOPT_PROGRESSDATA, nargs, &ez->progress_callback, &ez->progress_data, (CFUNC_Type)progress_function);
+	break;
+
+      case CURLOPT_HEADERFUNCTION:
+	return set_function_opt (ez, opt, CURLOPT_WRITEHEADER, nargs, &ez->writeheader_callback, &ez->writeheader_data, write_header_function);
+
+      case CURLOPT_DEBUGFUNCTION:
+      case CURLOPT_SSL_CTX_FUNCTION:
+	break;
+
+	/* data options */
+      case CURLOPT_READDATA:
+	return set_read_data_opt (ez, nargs);
+
+      case CURLOPT_WRITEDATA:
+	/* return set_write_data_opt (ez, opt, CURLOPT_WRITEDATA, nargs); */
+#ifdef HAVE_CURLOPT_SEEKDATA
+      case CURLOPT_SEEKDATA:
+#else
+      case CURLOPT_IOCTLDATA:
+#endif
+      case CURLOPT_PROGRESSDATA:
+      case CURLOPT_WRITEHEADER:
+      case CURLOPT_DEBUGDATA:
+      case CURLOPT_SSL_CTX_DATA:
+	break;
+
+	/* error options */
+      case CURLOPT_ERRORBUFFER:
+      case CURLOPT_STDERR:
+      case CURLOPT_FAILONERROR:
+	break;
+
+	/* network options */
+      case CURLOPT_URL:		       /* required option */
+      case CURLOPT_PROXY:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_PROXYPORT:
+	return set_long_opt (ez, opt, nargs, 0, 0);
+
+      case CURLOPT_PROXYTYPE:
+	return set_long_opt (ez, opt, nargs, 0, 0);   /* only certain values allowed */
+
+      case CURLOPT_HTTPPROXYTUNNEL:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+      case CURLOPT_INTERFACE:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_DNS_CACHE_TIMEOUT:
+	return set_long_opt (ez, opt, nargs, 1, 0L);
+
+#ifdef HAVE_CURLOPT_SHARE
+      case CURLOPT_SHARE:
+	return set_share_opt (ez, nargs);
+#else
+      case CURLOPT_DNS_USE_GLOBAL_CACHE:   /* obsolete and not encouraged */
+	break;
+#endif
+
+      case CURLOPT_BUFFERSIZE:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_PORT:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_TCP_NODELAY:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+	/* names and password options */
+      case CURLOPT_NETRC:
+	return set_long_opt (ez, opt, nargs, 0, 0L);   /* FIXME */
+
+      case CURLOPT_NETRC_FILE:
+#ifdef HAVE_CURLOPT_USERPWD
+      case CURLOPT_USERPWD:
+#endif
+      case CURLOPT_PROXYUSERPWD:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_HTTPAUTH:
+      case CURLOPT_PROXYAUTH:
+	return set_long_opt (ez, opt, nargs, 0, 0L);   /* FIXME */
+
+	/* HTTP options */
+      case CURLOPT_AUTOREFERER:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+#ifdef HAVE_CURLOPT_ACCEPT_ENCODING
+      case CURLOPT_ACCEPT_ENCODING:
+#else
+      case CURLOPT_ENCODING:
+#endif
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_FOLLOWLOCATION:
+      case CURLOPT_UNRESTRICTED_AUTH:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+      case CURLOPT_MAXREDIRS:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+#ifdef HAVE_CURLOPT_UPLOAD
+      case CURLOPT_UPLOAD:
+#else
+      case CURLOPT_PUT:		       /* deprecated */
+#endif
+      case CURLOPT_POST:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+      case CURLOPT_POSTFIELDS:
+	return set_postfields_opt (ez, nargs);
+      case CURLOPT_POSTFIELDSIZE:
+      case CURLOPT_POSTFIELDSIZE_LARGE:
+	return set_postfieldsize_opt (ez, opt, nargs);
+
+#ifdef HAVE_CURLOPT_MIMEPOST
+      case CURLOPT_MIMEPOST:
+	return set_mimepost_opt (ez, nargs);
+#else
+      case CURLOPT_HTTPPOST:	       /* FIXME: linked list */
+	break;
+#endif
+
+      case CURLOPT_REFERER:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_USERAGENT:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_HTTPHEADER:
+	return set_strlist_opt (ez, opt, nargs, &ez->httpheader);
+	break;
+      case CURLOPT_HTTP200ALIASES:
+	return set_strlist_opt (ez, opt, nargs, &ez->http200aliases);
+	break;
+
+      case CURLOPT_COOKIE:	       /* FIXME: check format */
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_COOKIEFILE:
+      case CURLOPT_COOKIEJAR:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_COOKIESESSION:
+      case CURLOPT_HTTPGET:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+      case CURLOPT_HTTP_VERSION:
+	return set_http_version_opt (ez, nargs);
+
+	/* FTP options */
+      case CURLOPT_FTPPORT:
+	return set_string_opt (ez, opt, nargs);
+      case CURLOPT_QUOTE:	       /* FIXME: linked list */
+	return set_strlist_opt (ez, opt, nargs, &ez->quote);
+#ifdef HAVE_CURLOPT_POSTQUOTE
+      case CURLOPT_POSTQUOTE:
+	return set_strlist_opt (ez, opt, nargs, &ez->postquote);
+#endif
+#ifdef HAVE_CURLOPT_PREQUOTE
+      case CURLOPT_PREQUOTE:
+	return set_strlist_opt (ez, opt, nargs, &ez->prequote);
+#endif
+      case CURLOPT_FTPLISTONLY:
+      case CURLOPT_FTPAPPEND:
+      case CURLOPT_FTP_USE_EPRT:
+      case CURLOPT_FTP_USE_EPSV:
+      case CURLOPT_FTP_CREATE_MISSING_DIRS:
+      case CURLOPT_FTP_RESPONSE_TIMEOUT:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+#ifdef HAVE_CURLOPT_USE_SSL
+      case CURLOPT_USE_SSL:
+#else
+      case CURLOPT_FTP_SSL: /* deprecated. */
+#endif
+	return set_long_opt (ez, opt, nargs, 0, 0L);   /* FIXME: specific values */
+
+#ifdef HAVE_CURLOPT_SOURCE_URL
+      case CURLOPT_SOURCE_URL:
+	return set_string_opt (ez, opt, nargs);
+#endif
+#ifdef HAVE_CURLOPT_SOURCE_USERPWD
+      case CURLOPT_SOURCE_USERPWD:
+	return set_string_opt (ez, opt, nargs);
+#endif
+#ifdef HAVE_CURLOPT_SOURCE_QUOTE
+      case CURLOPT_SOURCE_QUOTE:
+	return set_strlist_opt (ez, opt, nargs, &ez->source_quote);
+#endif
+#ifdef HAVE_CURLOPT_SOURCE_PREQUOTE
+      case CURLOPT_SOURCE_PREQUOTE:
+	return set_strlist_opt (ez, opt, nargs, &ez->source_prequote);
+#endif
+#ifdef HAVE_CURLOPT_SOURCE_POSTQUOTE
+      case CURLOPT_SOURCE_POSTQUOTE:
+	return set_strlist_opt (ez, opt, nargs, &ez->source_postquote);
+#endif
+#ifdef HAVE_CURLOPT_FTP_ACCOUNT
+      case CURLOPT_FTP_ACCOUNT:
+	return set_string_opt (ez, opt, nargs);
+#endif
+	/* protocol options */
+      case CURLOPT_TRANSFERTEXT:
+      case CURLOPT_CRLF:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+      case CURLOPT_RANGE:	       /* FIXME: NULL allowed */
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_RESUME_FROM:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_RESUME_FROM_LARGE:  /* FIXME: curl_off_t */
+	break;
+
+      case CURLOPT_CUSTOMREQUEST:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_FILETIME:
       case CURLOPT_NOBODY:
       case CURLOPT_INFILESIZE:
 	return set_long_opt (ez, opt, nargs, 1, 1L);
 
-      case CURLOPT_INFILESIZE_LARGE:   /* FIXME: curl_off_t */
-	break;
+      case CURLOPT_INFILESIZE_LARGE:   /* FIXME: curl_off_t */
+	break;
+
+      case CURLOPT_MAXFILESIZE:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+      case CURLOPT_MAXFILESIZE_LARGE:
+	break;			       /* FIXME: curl_off_t */
+
+      case CURLOPT_TIMECONDITION:      /* FIXME: specific values */
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_TIMEVALUE:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+	/* Connection options */
+      case CURLOPT_TIMEOUT:
+      case CURLOPT_LOW_SPEED_LIMIT:
+      case CURLOPT_LOW_SPEED_TIME:
+      case CURLOPT_MAXCONNECTS:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_MAX_RECV_SPEED_LARGE:
+      case CURLOPT_MAX_SEND_SPEED_LARGE:
+	return set_off_t_opt (ez, opt, nargs);
+
+      case CURLOPT_CLOSEPOLICY:	       /* FIXME: specific values */
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_FORBID_REUSE:       /* may want to avoid this */
+#if 0
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+#else
+	break;
+#endif
+
+      case CURLOPT_CONNECTTIMEOUT:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_IPRESOLVE:	       /* FIXME: specific values */
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+	/* SSL and Security Options */
+      case CURLOPT_SSLCERT:
+      case CURLOPT_SSLCERTTYPE:
+      /* case CURLOPT_SSLCERTPASSWD: */
+      case CURLOPT_SSLKEY:
+      case CURLOPT_SSLKEYTYPE:
+      case CURLOPT_SSLKEYPASSWD:
+      case CURLOPT_SSLENGINE:
+      case CURLOPT_SSLENGINE_DEFAULT:
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_SSL_VERIFYPEER:
+	return set_long_opt (ez, opt, nargs, 1, 1L);
+
+      case CURLOPT_SSLVERSION:	       /* FIXME: specific values */
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_CAINFO:
+      case CURLOPT_CAPATH:
+#ifdef HAVE_CURLOPT_RANDOM_FILE
+      case CURLOPT_RANDOM_FILE:
+#endif
+#ifdef HAVE_CURLOPT_EGDSOCKET
+      case CURLOPT_EGDSOCKET:
+#endif
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_SSL_VERIFYHOST:
+	return set_long_opt (ez, opt, nargs, 0, 0L);
+
+      case CURLOPT_SSL_CIPHER_LIST:    /* FIXME: check syntax */
+	return set_string_opt (ez, opt, nargs);
+
+      case CURLOPT_KRB4LEVEL:
+	return set_string_opt (ez, opt, nargs);
+
+	/* Misc */
+      case CURLOPT_PRIVATE:	       /* FIXME: provide interface?? */
+	break;
+
+	/* Telnet Options */
+      case CURLOPT_TELNETOPTIONS:      /* FIXME: linked list */
+	break;
+
+      default:
+	break;
+     }
+   SLang_verror (SL_INVALID_PARM, "cURL option is unknown or unsupported");
+   return -1;
+}
+
+static int set_size_opt (int nargs, size_t *sizep)
+{
+   long val;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this option");
+	return -1;
+     }
+   if (-1 == SLang_pop_long (&val))
+     return -1;
+   if (val < 0)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a non-negative size for this option");
+	return -1;
+     }
+   *sizep = (size_t) val;
+   return 0;
+}
+
+static int set_framing_opt (Easy_Type *ez, int nargs)
+{
+   int type;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single CURL_FRAME_* value");
+	return -1;
+     }
+   if (-1 == SLang_pop_int (&type))
+     return -1;
+
+   switch (type)
+     {
+      case CURL_FRAME_NONE:
+      case CURL_FRAME_LINES:
+      case CURL_FRAME_SSE:
+      case CURL_FRAME_LENGTH32:
+	break;
+
+      default:
+	SLang_verror (SL_INVALID_PARM, "Unknown or unsupported CURL_FRAME value");
+	return -1;
+     }
+
+   /* The records are typed by the framing, so discard any old ones */
+   reset_framer (&ez->framer);
+   ez->framer.type = type;
+   return 0;
+}
+
+static int set_digest_opt (Digest_Type *d, int nargs)
+{
+   int type;
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single CURL_DIGEST_* value");
+	return -1;
+     }
+   if (-1 == SLang_pop_int (&type))
+     return -1;
+
+   switch (type)
+     {
+      case CURL_DIGEST_CRC32C:
+	init_crc32c_table ();
+	/* drop */
+      case CURL_DIGEST_NONE:
+      case CURL_DIGEST_SHA256:
+	break;
+
+      default:
+	SLang_verror (SL_INVALID_PARM, "Unknown or unsupported CURL_DIGEST value");
+	return -1;
+     }
+
+   d->type = type;
+   init_digest (d);
+   return 0;
+}
+
+/* slang: curl_setopt (c, CURLOPT_RETRY_BACKOFF, delay [,max_delay [,factor]]) */
+static int set_retry_backoff_opt (Easy_Type *ez, int nargs)
+{
+   double vals[3];
+   int i;
+
+   if ((nargs < 1) || (nargs > 3))
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a delay, and optionally a maximum delay and a factor");
+	return -1;
+     }
+
+   vals[0] = RETRY_DELAY;
+   vals[1] = RETRY_MAX_DELAY;
+   vals[2] = RETRY_FACTOR;
+   for (i = 0; i < nargs; i++)
+     {
+	if (-1 == SLang_pop_double (&vals[i]))
+	  return -1;
+     }
+   if ((vals[0] < 0.0) || (vals[1] < vals[0]) || (vals[2] < 1.0))
+     {
+	SLang_verror (SL_INVALID_PARM, "Invalid CURLOPT_RETRY_BACKOFF values");
+	return -1;
+     }
+   ez->retry_delay = vals[0];
+   ez->retry_max_delay = vals[1];
+   ez->retry_factor = vals[2];
+   return 0;
+}
+
+/* Options that are implemented by the module itself */
+static int do_module_setopt (Easy_Type *ez, int opt, int nargs)
+{
+   int ival;
+   double dval;
+
+   switch (opt)
+     {
+      case CURLOPT_WRITE_COALESCE:
+	return set_size_opt (nargs, &ez->write_coalesce);
+
+      case CURLOPT_HEADER_COALESCE:
+	return set_size_opt (nargs, &ez->header_coalesce);
+
+      case CURLOPT_WRITE_FRAMING:
+	return set_framing_opt (ez, nargs);
+
+      case CURLOPT_WRITE_DIGEST:
+	return set_digest_opt (&ez->write_digest, nargs);
+
+      case CURLOPT_READ_DIGEST:
+	return set_digest_opt (&ez->read_digest, nargs);
+
+      case CURLOPT_QUEUE_PRIORITY:
+	if (nargs != 1)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Expecting a single priority value");
+	     return -1;
+	  }
+	return SLang_pop_int (&ez->queue_priority);
+
+      case CURLOPT_RETRY_MAX:
+	if (nargs != 1)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Expecting a single number of retries");
+	     return -1;
+	  }
+	if (-1 == SLang_pop_int (&ival))
+	  return -1;
+	ez->retry_max = (ival > 0) ? (unsigned int) ival : 0;
+	return 0;
+
+      case CURLOPT_RETRY_BACKOFF:
+	return set_retry_backoff_opt (ez, nargs);
+
+      case CURLOPT_RETRY_JITTER:
+	if (nargs != 1)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Expecting a single jitter value");
+	     return -1;
+	  }
+	if (-1 == SLang_pop_double (&dval))
+	  return -1;
+	if ((dval < 0.0) || (dval > 1.0))
+	  {
+	     SLang_verror (SL_INVALID_PARM, "CURLOPT_RETRY_JITTER must be between 0 and 1");
+	     return -1;
+	  }
+	ez->retry_jitter = dval;
+	return 0;
+
+      default:
+	break;
+     }
+   SLang_verror (SL_INVALID_PARM, "cURL option is unknown or unsupported");
+   return -1;
+}
+
+static void setopt_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   int opt;
+   int nargs = SLang_Num_Function_Args - 2;
+
+   if (nargs < 0)
+     {
+	SLang_verror (SL_USAGE_ERROR, "Usage: curl_setopt(curlobj, option, value)");
+	return;
+     }
+
+   if (-1 == SLreverse_stack (nargs + 2))
+     return;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+   if (-1 == SLang_pop_int (&opt))
+     {
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   if (opt >= MODULE_OPT_BASE)
+     (void) do_module_setopt (ez, opt, nargs);
+   else
+     (void) do_setopt (ez, (CURLoption)opt, nargs);
+
+   SLang_free_mmt (mmt);
+}
+
+/* Apply the settings that the module relies upon to a new or reset handle */
+static int init_easy_handle (Easy_Type *ez)
+{
+   CURLcode status;
+
+   if ((CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_ERRORBUFFER, ez->errbuf)))
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_VERBOSE, 0L)))
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_NOPROGRESS, 1L)))
+       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_PRIVATE, (char *)ez))))
+     {
+	SLang_verror (Curl_Error, "curl_easy_setopt: %s", curl_easy_strerror (status));
+	return -1;
+     }
+   return 0;
+}
+
+/* This puts the fields of an Easy_Type without a libcurl handle into a
+ * state that free_easy_type accepts.
+ */
+static void init_easy_type (Easy_Type *ez)
+{
+   memset ((char *) ez, 0, sizeof (Easy_Type));
+   init_file_sink (&ez->file_sink);
+   init_read_source (&ez->read_source);
+   ez->postfields_len = -1;
+   init_retry_policy (ez);
+}
+
+static void new_curl_intrin (char *url)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+
+   if (NULL == (ez = (Easy_Type *) SLmalloc (sizeof (Easy_Type))))
+     return;
+   init_easy_type (ez);
+
+   if (NULL == (ez->handle = curl_easy_init ()))
+     {
+	SLang_verror (SL_RunTime_Error, "curl_easy_init failed");
+	free_easy_type (ez);
+	return;
+     }
+
+   if (NULL == (ez->url = SLang_create_slstring (url)))
+     {
+	free_easy_type (ez);
+	return;
+     }
+
+   if (-1 == init_easy_handle (ez))
+     {
+	free_easy_type (ez);
+	return;
+     }
+
+   if (NULL == (mmt = SLang_create_mmt (Easy_Type_Id, (VOID_STAR) ez)))
+     {
+	free_easy_type (ez);
+	return;
+     }
+   ez->mmt = mmt;
+
+   if (-1 == set_string_opt_internal (ez, CURLOPT_URL, url))
+     {
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   if (-1 == SLang_push_mmt (mmt))
+     SLang_free_mmt (mmt);
+}
+
+/*{{{ Handle reuse */
+
+/* Return all of the options to their defaults.  Unlike a new handle, a
+ * reset one keeps its connections, DNS cache, and TLS session cache.
+ */
+static int reset_easy (Easy_Type *ez, char *url)
+{
+   curl_easy_reset (ez->handle);
+   /* curl_easy_reset leaves the share attached, and it may be freed below */
+   (void) curl_easy_setopt (ez->handle, CURLOPT_SHARE, NULL);
+   free_easy_options (ez);
+
+   if (-1 == init_easy_handle (ez))
+     return -1;
+
+   return set_string_opt_internal (ez, CURLOPT_URL, url);
+}
+
+/* slang: curl_reset (Curl_Type c [,String_Type url]) */
+static void reset_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   char *url = NULL;
+
+   if ((SLang_Num_Function_Args == 2)
+       && (-1 == SLang_pop_slstring (&url)))
+     return;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     goto free_return;
+
+   if (ez->multi != NULL)
+     SLang_verror (SL_INVALID_PARM, "The object must first be removed from the Curl_Multi_Type before it can be reset");
+   else
+     (void) reset_easy (ez, (url != NULL) ? url : ez->url);
+
+   SLang_free_mmt (mmt);
+
+   free_return:
+   if (url != NULL)
+     SLang_free_slstring (url);
+}
+
+/* Idle handles are kept here by curl_pool_put for reuse by curl_pool_get.
+ * The pool holds the Easy_Type objects themselves: a pooled object has no
+ * MMT, and curl_pool_get wraps it in a new one.
+ */
+#define HANDLE_POOL_SIZE 64
+static Easy_Type *Handle_Pool[HANDLE_POOL_SIZE];
+static unsigned int Handle_Pool_Num = 0;
+
+/* slang: Curl_Type curl_pool_get (String_Type url) */
+static void pool_get_intrin (char *url)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+
+   if (Handle_Pool_Num == 0)
+     {
+	new_curl_intrin (url);
+	return;
+     }
+
+   ez = Handle_Pool[--Handle_Pool_Num];
+   Handle_Pool[Handle_Pool_Num] = NULL;
+
+   if (NULL == (mmt = SLang_create_mmt (Easy_Type_Id, (VOID_STAR) ez)))
+     {
+	free_easy_type (ez);
+	return;
+     }
+   ez->mmt = mmt;
+
+   if ((-1 == set_string_opt_internal (ez, CURLOPT_URL, url))
+       || (-1 == SLang_push_mmt (mmt)))
+     SLang_free_mmt (mmt);
+}
+
+/* slang: curl_pool_put (Curl_Type c) */
+static void pool_put_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez, *pooled;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+   if (ez->multi != NULL)
+     {
+	SLang_verror (SL_INVALID_PARM, "The object must first be removed from the Curl_Multi_Type before it can be pooled");
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   if (NULL == (pooled = (Easy_Type *) SLmalloc (sizeof (Easy_Type))))
+     {
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   /* Move the handle out of the object, which is left closed so that any
+    * remaining references to it can no longer be used.
+    */
+   *pooled = *ez;
+   pooled->mmt = NULL;
+   init_easy_type (ez);
+   ez->mmt = mmt;
+   SLang_free_mmt (mmt);
+
+   /* The handle refers to the address of the errbuf and PRIVATE fields,
+    * which reset_easy updates.
+    */
+   if ((Handle_Pool_Num == HANDLE_POOL_SIZE)
+       || (-1 == reset_easy (pooled, pooled->url)))
+     {
+	/* Let it go */
+	free_easy_type (pooled);
+	return;
+     }
+
+   Handle_Pool[Handle_Pool_Num++] = pooled;
+}
+
+/*}}}*/
+
+static void perform_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   CURLcode status;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+   if (-1 == start_transfer (ez))
+     {
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   ez->flags |= PERFORM_RUNNING;
+   status = curl_easy_perform (ez->handle);
+   ez->flags &= ~PERFORM_RUNNING;
+
+   if ((-1 == end_transfer (ez, status == CURLE_OK))
+       && (status == CURLE_OK))
+     status = CURLE_WRITE_ERROR;
+
+   if (status != CURLE_OK)
+     throw_curl_error (status, ez->errbuf);
+
+   SLang_free_mmt (mmt);
+}
+
+static void close_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+   if (ez->multi != NULL)
+     {
+	SLang_verror (SL_INVALID_PARM, "The object must first be removed from the Curl_Multi_Type before it can be closed");
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   curl_easy_cleanup (ez->handle);
+   ez->handle = NULL;
+
+   SLang_free_mmt (mmt);
+}
+
+static void get_url_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+
+   if (NULL == (mmt = pop_easy_type (&ez, 0)))
+     return;
+
+   (void) SLang_push_string (ez->url);
+   SLang_free_mmt (mmt);
+}
+
+static void get_body_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   SLang_BString_Type *bstr;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+   if (ez->write_sink != CURL_SINK_BUFFER)
+     {
+	SLang_verror (SL_INVALID_PARM, "curl_get_body requires CURLOPT_WRITEFUNCTION to be CURL_SINK_BUFFER");
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   if (NULL != (bstr = byte_buffer_to_bstring (&ez->body)))
+     {
+	(void) SLang_push_bstring (bstr);
+	SLbstring_free (bstr);
+     }
+   SLang_free_mmt (mmt);
+}
+
+#ifdef HAVE_CURL_EASY_HEADER
+/* Create an slstring from the values of a header, which are combined into
+ * a comma separated list if the header occurs more than once.  The name
+ * is looked up case-insensitively by libcurl.
+ */
+static char *create_header_value (Easy_Type *ez, const char *name)
+{
+   struct curl_header *h;
+   Byte_Buffer_Type b;
+   size_t i, amount;
+   char *str;
+
+   if (CURLHE_OK != curl_easy_header (ez->handle, name, 0, CURLH_HEADER, -1, &h))
+     return NULL;
+
+   amount = h->amount;
+   if (amount == 1)
+     return SLang_create_slstring (h->value);
+
+   memset ((char *) &b, 0, sizeof (Byte_Buffer_Type));
+   for (i = 0; i < amount; i++)
+     {
+	if ((i > 0)
+	    && (CURLHE_OK != curl_easy_header (ez->handle, name, i, CURLH_HEADER, -1, &h)))
+	  break;
+
+	if (((i > 0) && (-1 == append_byte_buffer (&b, (unsigned char *) ", ", 2)))
+	    || (-1 == append_byte_buffer (&b, (unsigned char *) h->value, strlen (h->value))))
+	  {
+	     free_byte_buffer (&b);
+	     return NULL;
+	  }
+     }
+   str = SLang_create_nslstring ((char *) b.data, b.len);
+   free_byte_buffer (&b);
+   return str;
+}
+#endif
+
+/* slang: String_Type curl_get_header (Curl_Type c, String_Type name)
+ *  returns NULL if the header was not part of the response.
+ */
+static void get_header_intrin (char *name)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+#ifdef HAVE_CURL_EASY_HEADER
+   char *value;
+#endif
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+#ifdef HAVE_CURL_EASY_HEADER
+   if (NULL == (value = create_header_value (ez, name)))
+     (void) SLang_push_null ();
+   else
+     {
+	(void) SLang_push_string (value);
+	SLang_free_slstring (value);
+     }
+#else
+   (void) name;
+   SLang_verror (SL_NotImplemented_Error, "curl_get_header requires libcurl 7.83.0 or newer");
+#endif
+   SLang_free_mmt (mmt);
+}
+
+static char *create_lowercase_slstring (const char *str)
+{
+   char *lstr, *s;
+
+   if (NULL == (lstr = SLmalloc (strlen (str) + 1)))
+     return NULL;
+
+   s = lstr;
+   while (*str)
+     {
+	char ch = *str++;
+	if ((ch >= 'A') && (ch <= 'Z'))
+	  ch += 'a' - 'A';
+	*s++ = ch;
+     }
+   *s = 0;
+
+   s = SLang_create_slstring (lstr);
+   SLfree (lstr);
+   return s;
+}
+
+/* slang: Assoc_Type curl_get_headers (Curl_Type c)
+ *  The keys are the lowercased header names.
+ */
+static void get_headers_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+#ifdef HAVE_CURL_EASY_HEADER
+   SLang_Assoc_Array_Type *a;
+   struct curl_header *h;
+#endif
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+#ifdef HAVE_CURL_EASY_HEADER
+   if (NULL == (a = SLang_create_assoc (SLANG_STRING_TYPE, 0)))
+     {
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   h = NULL;
+   while (NULL != (h = curl_easy_nextheader (ez->handle, CURLH_HEADER, -1, h)))
+     {
+	char *key, *value;
+	int status;
+
+	/* Headers that occur more than once are combined when the first is seen */
+	if (h->index != 0)
+	  continue;
+
+	if (NULL == (key = create_lowercase_slstring (h->name)))
+	  break;
+	if (NULL == (value = create_header_value (ez, key)))
+	  {
+	     SLang_free_slstring (key);
+	     break;
+	  }
+
+	status = SLang_push_string (value);
+	SLang_free_slstring (value);
+	if ((status == -1)
+	    || (-1 == SLang_assoc_put (a, key)))
+	  {
+	     SLang_free_slstring (key);
+	     break;
+	  }
+	SLang_free_slstring (key);
+     }
+
+   if (h == NULL)
+     (void) SLang_push_assoc (a, 0);
+   SLang_free_assoc (a);
+#else
+   SLang_verror (SL_NotImplemented_Error, "curl_get_headers requires libcurl 7.83.0 or newer");
+#endif
+   SLang_free_mmt (mmt);
+}
+
+/* slang: String_Type curl_get_digest (Curl_Type c [,Int_Type which])
+ *  which is CURLOPT_WRITE_DIGEST (default) or CURLOPT_READ_DIGEST.  The
+ *  digest is returned as a hex string.
+ */
+static void get_digest_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   Digest_Type *d;
+   unsigned char bytes[32];
+   char hex[2*sizeof(bytes) + 1];
+   unsigned int i, n;
+   int which = CURLOPT_WRITE_DIGEST;
+
+   if ((SLang_Num_Function_Args == 2)
+       && (-1 == SLang_pop_int (&which)))
+     return;
+
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+
+   if (which == CURLOPT_WRITE_DIGEST)
+     d = &ez->write_digest;
+   else if (which == CURLOPT_READ_DIGEST)
+     d = &ez->read_digest;
+   else
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting CURLOPT_WRITE_DIGEST or CURLOPT_READ_DIGEST");
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   if (d->type == CURL_DIGEST_NONE)
+     (void) SLang_push_null ();
+   else
+     {
+	n = get_digest_bytes (d, bytes);
+	for (i = 0; i < n; i++)
+	  {
+	     hex[2*i] = "0123456789abcdef"[bytes[i] >> 4];
+	     hex[2*i+1] = "0123456789abcdef"[bytes[i] & 0xF];
+	  }
+	hex[2*n] = 0;
+	(void) SLang_push_string (hex);
+     }
+   SLang_free_mmt (mmt);
+}
+
+static int push_slist (struct curl_slist *slist)
+{
+   SLindex_Type num;
+   struct curl_slist *s;
+   SLang_Array_Type *at;
+   char **data;
+
+   if (slist == NULL)
+     return SLang_push_null ();
+
+   num = 0;
+   s = slist;
+   while (s != NULL)
+     {
+	num++;
+	s = s->next;
+     }
+
+   at = SLang_create_array (SLANG_STRING_TYPE, 0, NULL, &num, 1);
+   if (at == NULL)
+     return -1;
+
+   data = (char **) at->data;
+   s = slist;
+   while (s != NULL)
+     {
+	if ((slist->data != NULL)
+	    && (NULL == (*data = SLang_create_slstring (slist->data))))
+	  {
+	     SLang_free_array (at);
+	     return -1;
+	  }
+	data++;
+	s = s->next;
+     }
+   return SLang_push_array (at, 1);
+}
+
+static void get_info_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   CURLcode status;
+   char *str;
+   long lvar;
+   double dvar;
+   struct curl_slist *slist;
+   int info;
+
+   if (-1 == SLang_pop_int (&info))
+     return;
+
+   if (NULL == (mmt = pop_easy_type (&ez, 0)))
+     return;
+
+   switch ((CURLINFO) info)
+     {
+      case CURLINFO_EFFECTIVE_URL:
+      case CURLINFO_CONTENT_TYPE:
+	status = curl_easy_getinfo (ez->handle, info, &str);
+	if (status == CURLE_OK)
+	  (void) SLang_push_string (str);
+	break;
+
+      case CURLINFO_RESPONSE_CODE:
+      case CURLINFO_HTTP_CONNECTCODE:
+      case CURLINFO_FILETIME:
+      case CURLINFO_REDIRECT_COUNT:
+      case CURLINFO_HEADER_SIZE:
+      case CURLINFO_REQUEST_SIZE:
+      case CURLINFO_SSL_VERIFYRESULT:
+      case CURLINFO_HTTPAUTH_AVAIL:
+      case CURLINFO_PROXYAUTH_AVAIL:
+      case CURLINFO_OS_ERRNO:
+      case CURLINFO_NUM_CONNECTS:
+#ifdef HAVE_CURLINFO_HTTP_VERSION
+      case CURLINFO_HTTP_VERSION:
+#endif
+	status = curl_easy_getinfo (ez->handle, info, &lvar);
+	if (status == CURLE_OK)
+	  (void) SLang_push_long (lvar);
+	break;
+
+      case CURLINFO_TOTAL_TIME:
+      case CURLINFO_NAMELOOKUP_TIME:
+      case CURLINFO_CONNECT_TIME:
+      case CURLINFO_PRETRANSFER_TIME:
+      case CURLINFO_STARTTRANSFER_TIME:
+      case CURLINFO_REDIRECT_TIME:
+#ifdef HAVE_CURLINFO_SIZE_UPLOAD_T
+      case CURLINFO_SIZE_UPLOAD_T:
+#else
+      case CURLINFO_SIZE_UPLOAD:
+#endif
+#ifdef HAVE_CURLINFO_SIZE_DOWNLOAD_T
+      case CURLINFO_SIZE_DOWNLOAD_T:
+#else
+      case CURLINFO_SIZE_DOWNLOAD:
+#endif
+#ifdef HAVE_CURLINFO_SPEED_DOWNLOAD_T
+      case CURLINFO_SPEED_DOWNLOAD_T:
+#else
+      case CURLINFO_SPEED_DOWNLOAD:
+#endif
+#ifdef HAVE_CURLINFO_SPEED_UPLOAD_T
+      case CURLINFO_SPEED_UPLOAD_T:
+#else
+      case CURLINFO_SPEED_UPLOAD:
+#endif
+#ifdef HAVE_CURLINFO_CONTENT_LENGTH_DOWNLOAD_T
+      case CURLINFO_CONTENT_LENGTH_DOWNLOAD_T:
+#else
+      case CURLINFO_CONTENT_LENGTH_DOWNLOAD:
+#endif
+#ifdef HAVE_CURLINFO_CONTENT_LENGTH_UPLOAD_T
+      case CURLINFO_CONTENT_LENGTH_UPLOAD_T:
+#else
+      case CURLINFO_CONTENT_LENGTH_UPLOAD:
+#endif
+	status = curl_easy_getinfo (ez->handle, info, &dvar);
+	if (status == CURLE_OK)
+	  (void) SLang_push_double (dvar);
+	break;
+
+      case CURLINFO_SSL_ENGINES:
+      /* case CURLINFO_COOKIELIST: */
+	status = curl_easy_getinfo (ez->handle, info, &slist);
+	if (status == CURLE_OK)
+	  {
+	     (void) push_slist (slist);
+	     curl_slist_free_all (slist);
+	  }
+	break;
+
+      case CURLINFO_PRIVATE:
+	/* used internal to this module. */
+	/* drop */
+      default:
+	SLang_verror (SL_INVALID_PARM, "Unknown or unsupported info type");
+	status = CURLE_OK;
+	break;
+     }
+
+   if (status != CURLE_OK)
+     throw_curl_error (status, ez->errbuf);
+
+   SLang_free_mmt (mmt);
+}
+
+/*}}}*/
+
+/*{{{ Multi_Type Functions */
+
+static void throw_multi_error (CURLMcode err)
+{
+   SLang_verror (Curl_Error, "%s", curl_multi_strerror(err));
+}
+
+static SLang_MMT_Type *pop_multi_type (Multi_Type **mp, unsigned int flags)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+
+   *mp = NULL;
+   if (NULL == (mmt = SLang_pop_mmt (Multi_Type_Id)))
+     return NULL;
+
+   m = (Multi_Type *)SLang_object_from_mmt (mmt);
+   if (m->mhandle == NULL)
+     {
+	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type object has already been closed");
+	SLang_free_mmt (mmt);
+	return NULL;
+     }
+
+   if (m->flags & flags)
+     {
+	SLang_free_mmt (mmt);
+	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type is in an invalid state for this operation");
+	return NULL;
+     }
+
+   /* The handles of a multi cannot be closed, and their PERFORM_RUNNING
+    * state is that of the multi.  So there is no need to check them here.
+    */
+   *mp = m;
+   return mmt;
+}
+
+static double get_monotonic_time (void)
+{
+#ifdef CLOCK_MONOTONIC
+   struct timespec ts;
+
+   if (0 == clock_gettime (CLOCK_MONOTONIC, &ts))
+     return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+   return (double) time (NULL);
+}
+
+#ifdef HAVE_EPOLL
+/* libcurl calls this to tell which sockets need to be waited upon.  The
+ * socketp pointer is used to record whether the socket has been added to
+ * the epoll set.
+ */
+static int socket_callback (CURL *e, curl_socket_t s, int what, void *userp, void *socketp)
+{
+   Multi_Type *m = (Multi_Type *) userp;
+   struct epoll_event ev;
+
+   (void) e;
+   if (what == CURL_POLL_REMOVE)
+     {
+	/* The socket may have been closed already */
+	(void) epoll_ctl (m->epfd, EPOLL_CTL_DEL, s, NULL);
+	return 0;
+     }
+
+   memset ((char *)&ev, 0, sizeof (ev));
+   if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+   if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+   ev.data.fd = s;
+
+   if (socketp == NULL)
+     {
+	if ((-1 == epoll_ctl (m->epfd, EPOLL_CTL_ADD, s, &ev))
+	    && ((errno != EEXIST)
+		|| (-1 == epoll_ctl (m->epfd, EPOLL_CTL_MOD, s, &ev))))
+	  return -1;
+	(void) curl_multi_assign (m->mhandle, s, (void *) m);
+	return 0;
+     }
+   if (-1 == epoll_ctl (m->epfd, EPOLL_CTL_MOD, s, &ev))
+     return -1;
+   return 0;
+}
+
+static int timer_callback (CURLM *mh, long timeout_ms, void *userp)
+{
+   Multi_Type *m = (Multi_Type *) userp;
+
+   (void) mh;
+   if (timeout_ms < 0)
+     {
+	m->timer_set = 0;
+	return 0;
+     }
+   m->timer_set = 1;
+   m->timer_deadline = get_monotonic_time () + 1e-3*timeout_ms;
+   return 0;
+}
+
+static int init_multi_events (Multi_Type *m)
+{
+   m->epfd = epoll_create1 (EPOLL_CLOEXEC);
+   if (m->epfd == -1)
+     {
+	SLang_verror (Curl_Error, "epoll_create1 failed: %s", strerror (errno));
+	return -1;
+     }
+
+   m->wakeup_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (m->wakeup_fd != -1)
+     {
+	struct epoll_event ev;
+
+	memset ((char *)&ev, 0, sizeof (ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = m->wakeup_fd;
+	if (-1 == epoll_ctl (m->epfd, EPOLL_CTL_ADD, m->wakeup_fd, &ev))
+	  {
+	     (void) close (m->wakeup_fd);
+	     m->wakeup_fd = -1;
+	  }
+     }
+   if (m->wakeup_fd == -1)
+     {
+	SLang_verror (Curl_Error, "Unable to create a wakeup descriptor: %s", strerror (errno));
+	return -1;
+     }
+
+   (void) curl_multi_setopt (m->mhandle, CURLMOPT_SOCKETFUNCTION, socket_callback);
+   (void) curl_multi_setopt (m->mhandle, CURLMOPT_SOCKETDATA, (void *) m);
+   (void) curl_multi_setopt (m->mhandle, CURLMOPT_TIMERFUNCTION, timer_callback);
+   (void) curl_multi_setopt (m->mhandle, CURLMOPT_TIMERDATA, (void *) m);
+   return 0;
+}
+
+static void free_multi_events (Multi_Type *m)
+{
+   if (m->wakeup_fd != -1)
+     (void) close (m->wakeup_fd);
+   m->wakeup_fd = -1;
+   if (m->epfd != -1)
+     (void) close (m->epfd);
+   m->epfd = -1;
+}
+#endif
+
+/*{{{ Scheduling of the transfers of a multi */
+
+/* Copy the lowercased host name of a URL to buf.  The scheme, user info,
+ * and port are omitted.
+ */
+static void get_url_host (char *url, char *buf, size_t buflen)
+{
+   char *p, *end, *at;
+   size_t len;
+
+   if (url == NULL)
+     url = "";
+   if (NULL != (p = strstr (url, "://")))
+     url = p + 3;
+
+   end = url + strcspn (url, "/?#");
+   if ((NULL != (at = memchr (url, '@', end - url))))
+     url = at + 1;
+
+   if (*url == '[')
+     {
+	/* IPv6 address literal */
+	if (NULL != (p = memchr (url, ']', end - url)))
+	  end = p + 1;
+     }
+   else if (NULL != (p = memchr (url, ':', end - url)))
+     end = p;
+
+   len = end - url;
+   if (len >= buflen)
+     len = buflen - 1;
+   for (p = buf; len; len--)
+     *p++ = tolower ((unsigned char) *url++);
+   *p = 0;
+}
+
+static unsigned int hash_host_name (char *name)
+{
+   unsigned int h = 5381;
+   while (*name)
+     h = 33*h + (unsigned char) *name++;
+   return h % MULTI_HOST_TABLE_SIZE;
+}
+
+static Multi_Host_Type *get_multi_host (Multi_Type *m, char *name, int create)
+{
+   Multi_Host_Type *h;
+   unsigned int i = hash_host_name (name);
+
+   for (h = m->hosts[i]; h != NULL; h = h->next)
+     {
+	if (0 == strcmp (h->name, name))
+	  return h;
+     }
+   if (create == 0)
+     return NULL;
+
+   if (NULL == (h = (Multi_Host_Type *) SLcalloc (1, sizeof (Multi_Host_Type))))
+     return NULL;
+   if (NULL == (h->name = SLang_create_slstring (name)))
+     {
+	SLfree ((char *) h);
+	return NULL;
+     }
+   h->weight = 1.0;
+   h->request_limit.rate = -1.0;
+   h->byte_limit.rate = -1.0;
+   h->next = m->hosts[i];
+   m->hosts[i] = h;
+   return h;
+}
+
+static void free_multi_hosts (Multi_Type *m)
+{
+   unsigned int i;
+
+   for (i = 0; i < MULTI_HOST_TABLE_SIZE; i++)
+     {
+	Multi_Host_Type *h = m->hosts[i];
+	while (h != NULL)
+	  {
+	     Multi_Host_Type *next = h->next;
+	     SLang_free_slstring (h->name);
+	     SLfree ((char *) h);
+	     h = next;
+	  }
+	m->hosts[i] = NULL;
+     }
+}
+
+/* Returns non-zero if a is to be admitted before b */
+static int queue_before (Easy_Type *a, Easy_Type *b)
+{
+   if (a->queue_priority != b->queue_priority)
+     return a->queue_priority > b->queue_priority;
+   if (a->queue_tag != b->queue_tag)
+     return a->queue_tag < b->queue_tag;
+   return a->queue_seq < b->queue_seq;
+}
+
+static void queue_set (Multi_Type *m, unsigned int i, Easy_Type *ez)
+{
+   m->queue[i] = ez;
+   ez->queue_index = i + 1;
+}
+
+static void queue_sift_up (Multi_Type *m, unsigned int i)
+{
+   Easy_Type *ez = m->queue[i];
+
+   while (i > 0)
+     {
+	unsigned int parent = (i - 1)/2;
+	if (0 == queue_before (ez, m->queue[parent]))
+	  break;
+	queue_set (m, i, m->queue[parent]);
+	i = parent;
+     }
+   queue_set (m, i, ez);
+}
+
+static void queue_sift_down (Multi_Type *m, unsigned int i)
+{
+   Easy_Type *ez = m->queue[i];
+   unsigned int n = m->num_queued;
+
+   while (1)
+     {
+	unsigned int child = 2*i + 1;
+	if (child >= n)
+	  break;
+	if ((child + 1 < n) && queue_before (m->queue[child+1], m->queue[child]))
+	  child++;
+	if (0 == queue_before (m->queue[child], ez))
+	  break;
+	queue_set (m, i, m->queue[child]);
+	i = child;
+     }
+   queue_set (m, i, ez);
+}
+
+static int push_queue (Multi_Type *m, Easy_Type *ez)
+{
+   if (m->num_queued == m->max_queued)
+     {
+	unsigned int new_max = 2*m->max_queued + 32;
+	Easy_Type **new_queue;
+
+	if (NULL == (new_queue = (Easy_Type **) SLrealloc ((char *) m->queue, new_max * sizeof (Easy_Type *))))
+	  return -1;
+	m->queue = new_queue;
+	m->max_queued = new_max;
+     }
+
+   m->queue[m->num_queued] = ez;
+   m->num_queued++;
+   queue_sift_up (m, m->num_queued - 1);
+   return 0;
+}
+
+/* Queue the handle with a finish tag that advances by the inverse of the
+ * weight of its host.  Hence the hosts of equal priority transfers are
+ * admitted in proportion to their weights.
+ */
+static int queue_handle (Multi_Type *m, Easy_Type *ez)
+{
+   Multi_Host_Type *h;
+   char host[256];
+   double start;
+
+   get_url_host (ez->url, host, sizeof (host));
+   if (NULL == (h = get_multi_host (m, host, 1)))
+     return -1;
+
+   start = (h->last_tag > m->vtime) ? h->last_tag : m->vtime;
+   h->last_tag = ez->queue_tag = start + 1.0/h->weight;
+   ez->queue_seq = m->queue_seq++;
+   ez->queue_host = h;
+
+   return push_queue (m, ez);
+}
+
+static void unqueue_handle (Multi_Type *m, Easy_Type *ez)
+{
+   unsigned int i = ez->queue_index - 1;
+   Easy_Type *last;
+
+   ez->queue_index = 0;
+   m->num_queued--;
+   if (i == m->num_queued)
+     return;
+
+   last = m->queue[m->num_queued];
+   queue_set (m, i, last);
+   if ((i > 0) && queue_before (last, m->queue[(i - 1)/2]))
+     queue_sift_up (m, i);
+   else
+     queue_sift_down (m, i);
+}
+
+/*}}}*/
+
+/*{{{ Rate limits of a multi */
+
+static void refill_token_bucket (Token_Bucket_Type *b, Rate_Limit_Type *l, double now)
+{
+   if (b->last == 0.0)
+     b->tokens = l->burst;
+   else if (now > b->last)
+     {
+	b->tokens += (now - b->last) * l->rate;
+	if (b->tokens > l->burst)
+	  b->tokens = l->burst;
+     }
+   b->last = now;
+}
+
+/* A transfer may start if a request token is available, and the bytes of
+ * the completed transfers have not overdrawn the byte bucket.  This returns
+ * 0 if that is the case, otherwise the time at which it will be.
+ */
+static double get_rate_limit_wait (Token_Bucket_Type *rb, Rate_Limit_Type *rl,
+				   Token_Bucket_Type *bb, Rate_Limit_Type *bl, double now)
+{
+   double t = 0.0;
+
+   if (rl->rate > 0.0)
+     {
+	refill_token_bucket (rb, rl, now);
+	if (rb->tokens < 1.0)
+	  t = now + (1.0 - rb->tokens)/rl->rate;
+     }
+   if (bl->rate > 0.0)
+     {
+	refill_token_bucket (bb, bl, now);
+	if ((bb->tokens < 0.0) && (now - bb->tokens/bl->rate > t))
+	  t = now - bb->tokens/bl->rate;
+     }
+   return t;
+}
+
+static Rate_Limit_Type *get_host_request_limit (Multi_Type *m, Multi_Host_Type *h)
+{
+   return (h->request_limit.rate < 0.0) ? &m->host_request_limit : &h->request_limit;
+}
+
+static Rate_Limit_Type *get_host_byte_limit (Multi_Type *m, Multi_Host_Type *h)
+{
+   return (h->byte_limit.rate < 0.0) ? &m->host_byte_limit : &h->byte_limit;
+}
+
+/* Charge the bytes of a completed transfer to the byte buckets */
+static void charge_transfer_bytes (Multi_Type *m, Easy_Type *ez)
+{
+   Multi_Host_Type *h = ez->queue_host;
+   Rate_Limit_Type *l;
+   double bytes = 0.0, now;
+   long header_size = 0;
+#ifdef HAVE_CURLINFO_SIZE_DOWNLOAD_T
+   curl_off_t size;
+#else
+   double size;
+#endif
+
+   if (m->rate_limited == 0)
+     return;
+
+   size = 0;
+   if (CURLE_OK == curl_easy_getinfo (ez->handle, CURLINFO_SIZE_DOWNLOAD, &size))
+     bytes += (double) size;
+   size = 0;
+   if (CURLE_OK == curl_easy_getinfo (ez->handle, CURLINFO_SIZE_UPLOAD, &size))
+     bytes += (double) size;
+   if (CURLE_OK == curl_easy_getinfo (ez->handle, CURLINFO_HEADER_SIZE, &header_size))
+     bytes += (double) header_size;
+
+   now = get_monotonic_time ();
+   if (m->byte_limit.rate > 0.0)
+     {
+	refill_token_bucket (&m->byte_bucket, &m->byte_limit, now);
+	m->byte_bucket.tokens -= bytes;
+     }
+   if ((h != NULL) && ((l = get_host_byte_limit (m, h))->rate > 0.0))
+     {
+	refill_token_bucket (&h->byte_bucket, l, now);
+	h->byte_bucket.tokens -= bytes;
+     }
+}
+
+/* Set a queued handle aside until its host is no longer over its limits,
+ * so that it does not hold up the transfers to other hosts.
+ */
+static void hold_handle (Multi_Type *m, Multi_Host_Type *h, Easy_Type *ez, double ready_at)
+{
+   ez->held_prev = h->held_tail;
+   ez->held_next = NULL;
+   ez->flags |= MULTI_HELD;
+   if (h->held_tail == NULL)
+     h->held_head = ez;
+   else
+     h->held_tail->held_next = ez;
+   h->held_tail = ez;
+   m->num_held++;
+
+   h->ready_at = ready_at;
+   if (h->is_held == 0)
+     {
+	h->is_held = 1;
+	h->held_host_next = m->held_hosts;
+	m->held_hosts = h;
+     }
+}
+
+static void unlink_held_handle (Multi_Type *m, Easy_Type *ez)
+{
+   Multi_Host_Type *h = ez->queue_host;
+
+   if (ez->held_prev == NULL)
+     h->held_head = ez->held_next;
+   else
+     ez->held_prev->held_next = ez->held_next;
+   if (ez->held_next == NULL)
+     h->held_tail = ez->held_prev;
+   else
+     ez->held_next->held_prev = ez->held_prev;
+   ez->held_prev = ez->held_next = NULL;
+   ez->flags &= ~MULTI_HELD;
+   m->num_held--;
+}
+
+/* The time at which a rate limit permits the next transfer to start, or 0
+ * if none is waiting for one.
+ */
+static double get_rate_limit_ready (Multi_Type *m)
+{
+   Multi_Host_Type *h;
+   double t = 0.0;
+
+   if (m->num_queued)
+     t = m->ready_at;
+
+   for (h = m->held_hosts; h != NULL; h = h->held_host_next)
+     {
+	if ((h->held_head != NULL) && ((t == 0.0) || (h->ready_at < t)))
+	  t = h->ready_at;
+     }
+   return t;
+}
+
+/*}}}*/
+
+static void unlink_done_handle (Multi_Type *m, Easy_Type *ez)
+{
+   if (ez->done_prev == NULL)
+     m->done_head = ez->done_next;
+   else
+     ez->done_prev->done_next = ez->done_next;
+   if (ez->done_next == NULL)
+     m->done_tail = ez->done_prev;
+   else
+     ez->done_next->done_prev = ez->done_prev;
+   ez->done_prev = ez->done_next = NULL;
+   ez->flags &= ~MULTI_DONE;
+}
+
+static void unlink_retry_handle (Multi_Type *m, Easy_Type *ez)
+{
+   if (ez->retry_prev == NULL)
+     m->retry_head = ez->retry_next;
+   else
+     ez->retry_prev->retry_next = ez->retry_next;
+   if (ez->retry_next != NULL)
+     ez->retry_next->retry_prev = ez->retry_prev;
+   ez->retry_prev = ez->retry_next = NULL;
+   ez->flags &= ~MULTI_RETRY;
+   m->num_retrying--;
+}
+
+static int multi_remove_handle_internal (Multi_Type *m, Easy_Type *ez)
+{
+   CURLMcode status = CURLM_OK;
+
+   if (ez->flags & MULTI_DONE)
+     unlink_done_handle (m, ez);
+
+   if (ez->queue_index)
+     unqueue_handle (m, ez);	       /* libcurl has not seen it yet */
+   else if (ez->flags & MULTI_RETRY)
+     unlink_retry_handle (m, ez);      /* removed from libcurl already */
+   else if (ez->flags & MULTI_HELD)
+     unlink_held_handle (m, ez);
+   else
+     {
+	status = curl_multi_remove_handle (m->mhandle, ez->handle);
+	/* If the transfer has not been reported as done, discard its output */
+	(void) end_transfer (ez, 0);
+     }
+
+   if (ez->prev != NULL)
+     ez->prev->next = ez->next;
+   else
+     m->ez = ez->next;
+   if (ez->next != NULL)
+     ez->next->prev = ez->prev;
+
+   ez->multi = NULL;
+   ez->next = NULL;
+   ez->prev = NULL;
+   SLang_free_mmt (ez->mmt);		       /* free from multi */
+   m->length -= 1;
+
+   if (status != CURLM_OK)
+     {
+	throw_multi_error (status);
+	return -1;
+     }
+   return 0;
+}
+
+/* Return the held handles of the hosts whose limits permit it to the queue.
+ * Only as many as there are request tokens are returned at a time.
+ */
+static int release_held_handles (Multi_Type *m, double now)
+{
+   Multi_Host_Type **hp = &m->held_hosts;
+   Multi_Host_Type *h;
+
+   while (NULL != (h = *hp))
+     {
+	Rate_Limit_Type *rl = get_host_request_limit (m, h);
+	double num, t = 0.0;
+
+	if ((h->held_head != NULL)
+	    && ((h->ready_at > now)
+		|| (0.0 != (t = get_rate_limit_wait (&h->request_bucket, rl, &h->byte_bucket,
+						     get_host_byte_limit (m, h), now)))))
+	  {
+	     if (t != 0.0)
+	       h->ready_at = t;
+	     hp = &h->held_host_next;
+	     continue;
+	  }
+
+	/* With only a byte limit, all of them may start until it is exceeded */
+	num = (rl->rate > 0.0) ? h->request_bucket.tokens : (double) m->num_held;
+	while ((num >= 1.0) && (h->held_head != NULL))
+	  {
+	     Easy_Type *ez = h->held_head;
+
+	     unlink_held_handle (m, ez);
+	     if (-1 == push_queue (m, ez))
+	       {
+		  (void) multi_remove_handle_internal (m, ez);
+		  return -1;
+	       }
+	     num -= 1.0;
+	  }
+
+	if (h->held_head == NULL)
+	  {
+	     *hp = h->held_host_next;
+	     h->held_host_next = NULL;
+	     h->is_held = 0;
+	     continue;
+	  }
+	h->ready_at = now + (1.0 - num)/rl->rate;
+	hp = &h->held_host_next;
+     }
+   return 0;
+}
+
+/* Hand the queued handles to libcurl while fewer than max_running transfers
+ * are running.  This returns the number of handles that were admitted.  A
+ * handle that cannot be started is removed from the multi.
+ */
+static int admit_queued_handles (Multi_Type *m)
+{
+   double now = 0.0;
+   int num = 0;
+
+   m->ready_at = 0.0;
+   if (m->rate_limited)
+     {
+	now = get_monotonic_time ();
+	if (-1 == release_held_handles (m, now))
+	  return -1;
+     }
+
+   while (m->num_queued
+	  && ((m->max_running == 0) || (m->num_running < m->max_running)))
+     {
+	Easy_Type *ez = m->queue[0];
+	Multi_Host_Type *h = ez->queue_host;
+	CURLMcode status;
+
+	if (m->rate_limited)
+	  {
+	     Rate_Limit_Type *rl = get_host_request_limit (m, h);
+	     double t;
+
+	     /* The limits of the multi hold back all of the transfers */
+	     t = get_rate_limit_wait (&m->request_bucket, &m->request_limit,
+				      &m->byte_bucket, &m->byte_limit, now);
+	     if (t != 0.0)
+	       {
+		  m->ready_at = t;
+		  break;
+	       }
+	     t = get_rate_limit_wait (&h->request_bucket, rl,
+				      &h->byte_bucket, get_host_byte_limit (m, h), now);
+	     if (t != 0.0)
+	       {
+		  unqueue_handle (m, ez);
+		  hold_handle (m, h, ez, t);
+		  continue;
+	       }
+	     if (m->request_limit.rate > 0.0)
+	       m->request_bucket.tokens -= 1.0;
+	     if (rl->rate > 0.0)
+	       h->request_bucket.tokens -= 1.0;
+	  }
+
+	unqueue_handle (m, ez);
+	if (ez->queue_tag > m->vtime)
+	  m->vtime = ez->queue_tag;
+
+	if (-1 == start_transfer (ez))
+	  {
+	     (void) multi_remove_handle_internal (m, ez);
+	     return -1;
+	  }
+	status = curl_multi_add_handle (m->mhandle, ez->handle);
+	if (status != CURLM_OK)
+	  {
+	     throw_multi_error (status);
+	     (void) multi_remove_handle_internal (m, ez);
+	     return -1;
+	  }
+	m->num_running++;
+	num++;
+     }
+   return num;
+}
+
+/*{{{ Retrying the transfers of a multi */
+
+/* A uniformly distributed number in [0,1) for the jitter.  This does not
+ * disturb the state of rand, and differs between processes so that their
+ * retries are not synchronized.
+ */
+static double retry_random (void)
+{
+   static uint32_t state = 0;
+
+   if (state == 0)
+     state = ((uint32_t) time (NULL) ^ ((uint32_t) getpid () << 16)) | 1;
+
+   state ^= state << 13;
+   state ^= state >> 17;
+   state ^= state << 5;
+   return state / 4294967296.0;
+}
+
+/* Transfers that failed in one of these ways may succeed if retried */
+static int is_retryable_outcome (Easy_Type *ez, CURLcode status)
+{
+   long code = 0;
+
+   switch (status)
+     {
+      case CURLE_OK:
+	(void) curl_easy_getinfo (ez->handle, CURLINFO_RESPONSE_CODE, &code);
+	return ((code == 408) || (code == 429) || (code == 502)
+		|| (code == 503) || (code == 504));
+
+      case CURLE_COULDNT_CONNECT:
+      case CURLE_OPERATION_TIMEDOUT:
+      case CURLE_SEND_ERROR:
+      case CURLE_RECV_ERROR:
+      case CURLE_GOT_NOTHING:
+      case CURLE_PARTIAL_FILE:
+#ifdef HAVE_CURLE_HTTP2_STREAM
+      case CURLE_HTTP2:
+      case CURLE_HTTP2_STREAM:
+#endif
+	return 1;
+
+      default:
+	return 0;
+     }
+}
+
+/* The delay grows by retry_factor with each retry, up to retry_max_delay,
+ * and retry_jitter of it is random.  A Retry-After header takes precedence
+ * unless it asks for more than retry_max_delay, in which case -1 is
+ * returned to indicate that the transfer is not to be retried.
+ */
+static double get_retry_delay (Easy_Type *ez)
+{
+   double delay = ez->retry_delay;
+   unsigned int i;
+#ifdef HAVE_CURLINFO_RETRY_AFTER
+   curl_off_t retry_after = 0;
+#endif
+
+   for (i = 0; (i < ez->retry_count) && (delay < ez->retry_max_delay); i++)
+     delay *= ez->retry_factor;
+   if (delay > ez->retry_max_delay)
+     delay = ez->retry_max_delay;
+   delay -= ez->retry_jitter * delay * retry_random ();
+
+#ifdef HAVE_CURLINFO_RETRY_AFTER
+   if ((CURLE_OK == curl_easy_getinfo (ez->handle, CURLINFO_RETRY_AFTER, &retry_after))
+       && (retry_after > 0))
+     {
+	if ((double) retry_after > ez->retry_max_delay)
+	  return -1.0;
+	if ((double) retry_after > delay)
+	  delay = (double) retry_after;
+     }
+#endif
+   return delay;
+}
+
+/* If the retry policy of the handle permits, take the completed transfer
+ * out of libcurl and arrange for it to be queued again once the delay has
+ * passed.  Returns 0 if the transfer will be retried, or -1 if not.
+ * Only transfers that use the native sinks are retried: the data that a
+ * failed attempt passed to a S-Lang write or header callback cannot be
+ * taken back, and that of a read callback cannot be read again.
+ */
+static int schedule_retry (Multi_Type *m, Easy_Type *ez, CURLcode status)
+{
+   Easy_Type *prev, *next;
+   double delay;
+
+   if ((ez->retry_count >= ez->retry_max)
+       || (ez->write_callback != NULL)
+       || (ez->writeheader_callback != NULL)
+       || (ez->read_callback != NULL)
+       || (0 == is_retryable_outcome (ez, status))
+       || (0 > (delay = get_retry_delay (ez))))
+     return -1;
+
+   (void) curl_multi_remove_handle (m->mhandle, ez->handle);
+   (void) end_transfer (ez, 0);	       /* discard the output of the attempt */
+
+   ez->retry_count++;
+   ez->retry_at = get_monotonic_time () + delay;
+   /* The list is ordered by the time of the retry */
+   prev = NULL;
+   next = m->retry_head;
+   while ((next != NULL) && (next->retry_at <= ez->retry_at))
+     {
+	prev = next;
+	next = next->retry_next;
+     }
+   ez->retry_prev = prev;
+   ez->retry_next = next;
+   if (prev == NULL)
+     m->retry_head = ez;
+   else
+     prev->retry_next = ez;
+   if (next != NULL)
+     next->retry_prev = ez;
+   ez->flags |= MULTI_RETRY;
+   m->num_retrying++;
+   return 0;
+}
+
+/* Move the transfers that libcurl reports as completed to the done list,
+ * from which curl_multi_info_read takes them, unless they are to be
+ * retried.  Hence only the final outcomes are reported.
+ */
+static int collect_multi_messages (Multi_Type *m)
+{
+   CURLMsg *msg;
+   int msgs_in_queue;
+
+   while (NULL != (msg = curl_multi_info_read (m->mhandle, &msgs_in_queue)))
+     {
+	CURLcode status;
+	Easy_Type *ez;
+
+	if (msg->msg != CURLMSG_DONE)
+	  continue;
+
+	/* The Easy_Type object was set in the new_curl_intrin function */
+	status = curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (char **)&ez);
+	if ((status != CURLE_OK) || (ez == NULL))
+	  {
+	     throw_curl_error (status, "Internal cURL error");
+	     return -1;
+	  }
+
+	status = msg->data.result;
+	charge_transfer_bytes (m, ez);
+	if (0 == schedule_retry (m, ez, status))
+	  continue;
+
+	ez->done_status = status;
+	ez->done_prev = m->done_tail;
+	ez->done_next = NULL;
+	ez->flags |= MULTI_DONE;
+	if (m->done_tail == NULL)
+	  m->done_head = ez;
+	else
+	  m->done_tail->done_next = ez;
+	m->done_tail = ez;
+     }
+   return 0;
+}
+
+/* Return the transfers whose retry delay has passed to the queue */
+static int requeue_due_retries (Multi_Type *m)
+{
+   Easy_Type *ez;
+   double now;
+
+   if (m->retry_head == NULL)
+     return 0;
+
+   now = get_monotonic_time ();
+   while ((NULL != (ez = m->retry_head)) && (ez->retry_at <= now))
+     {
+	unlink_retry_handle (m, ez);
+
+	if (-1 == queue_handle (m, ez))
+	  {
+	     (void) multi_remove_handle_internal (m, ez);
+	     return -1;
+	  }
+     }
+   return 0;
+}
+
+/* Limit a wait of dt seconds to the time until the next retry is due, or
+ * until the rate limits permit a waiting transfer to start.
+ */
+static double get_multi_wait (Multi_Type *m, double dt)
+{
+   double t = 0.0, ready_at;
+
+   if (m->retry_head != NULL)
+     t = m->retry_head->retry_at;
+   if (m->rate_limited
+       && (0.0 != (ready_at = get_rate_limit_ready (m)))
+       && ((t == 0.0) || (ready_at < t)))
+     t = ready_at;
+
+   if (t == 0.0)
+     return dt;
+
+   t -= get_monotonic_time ();
+   if (t < 0.0)
+     t = 0.0;
+   return (t < dt) ? t : dt;
+}
+
+/*}}}*/
+
+/* This is called after libcurl has processed the transfers.  It collects
+ * the completed transfers, requeues the retries that are due, and admits
+ * queued transfers in place of the completed ones.  It returns the number
+ * of transfers that were admitted.
+ */
+static int process_multi_transfers (Multi_Type *m, int running_handles)
+{
+   m->num_running = running_handles;
+   if ((-1 == collect_multi_messages (m))
+       || (-1 == requeue_due_retries (m)))
+     return -1;
+   return admit_queued_handles (m);
+}
+
+/* The number of transfers that have not completed */
+static int get_multi_pending (Multi_Type *m)
+{
+   return (int) (m->num_running + m->num_queued + m->num_retrying + m->num_held);
+}
+
+static void multi_close_internal (Multi_Type *m)
+{
+   Easy_Type *ez;
+
+   ez = m->ez;
+   while (ez != NULL)
+     {
+	Easy_Type *next = ez->next;
+	(void) multi_remove_handle_internal (m, ez);
+	ez = next;
+     }
+   m->ez = NULL;
+   if (m->queue != NULL)
+     SLfree ((char *) m->queue);
+   m->queue = NULL;
+   m->num_queued = m->max_queued = 0;
+   m->done_head = m->done_tail = NULL;
+   m->retry_head = NULL;
+   m->num_retrying = 0;
+   m->held_hosts = NULL;
+   m->num_held = 0;
+   free_multi_hosts (m);
+   if (m->mhandle != NULL)
+     (void) curl_multi_cleanup (m->mhandle);
+   m->mhandle = NULL;
+#ifdef HAVE_EPOLL
+   free_multi_events (m);
+#endif
+}
+
+static void free_multi_type (Multi_Type *m)
+{
+   if (m == NULL)
+     return;
+
+   multi_close_internal (m);
+   SLfree ((char *) m);
+}
+
+static void multi_remove_handle (void)
+{
+   Easy_Type *ez;
+   SLang_MMT_Type *ez_mmt, *m_mmt;
+   Multi_Type *m;
+
+   if (NULL == (ez_mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+   if (NULL == (m_mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     {
+	SLang_free_mmt (ez_mmt);
+	return;
+     }
+
+   if (ez->multi == m)
+     (void) multi_remove_handle_internal (m, ez);
+
+   SLang_free_mmt (ez_mmt);
+   SLang_free_mmt (m_mmt);
+}
+
+static void multi_close (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+
+   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     return;
+
+   multi_close_internal (m);
+   SLang_free_mmt (mmt);
+}
+
+static void multi_add_handle (void)
+{
+   Easy_Type *ez;
+   SLang_MMT_Type *ez_mmt, *m_mmt;
+   Multi_Type *m;
+
+   if (NULL == (ez_mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+     return;
+   if (NULL == (m_mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     {
+	SLang_free_mmt (ez_mmt);
+	return;
+     }
+   if (ez->multi != NULL)
+     {
+	SLang_verror (SL_INVALID_PARM, "Curl_Type is already attached to a Curl_Multi_Type object");
+	SLang_free_mmt (ez_mmt);
+	SLang_free_mmt (m_mmt);
+	return;
+     }
+
+   if (-1 == queue_handle (m, ez))
+     {
+	SLang_free_mmt (ez_mmt);
+	SLang_free_mmt (m_mmt);
+	return;
+     }
+
+   ez->multi = m;
+   ez->retry_count = 0;
+   ez->prev = NULL;
+   ez->next = m->ez;
+   if (m->ez != NULL)
+     m->ez->prev = ez;
+   m->ez = ez;
+   m->length += 1;
+
+   /* The ez_mmt is not freed because it is now reference my the multi_type.
+    * Unless CURLMOPT_MAX_RUNNING has been reached, the handle is passed to
+    * libcurl right away.  If that fails, it is removed again.
+    */
+   (void) admit_queued_handles (m);
+   SLang_free_mmt (m_mmt);
+}
+
+#ifdef HAVE_EPOLL
+# define MULTI_WAKEUP_FD(m) ((m)->wakeup_fd)
+#else
+# define MULTI_WAKEUP_FD(m) (-1)
+#endif
+
+/* Read the wakeup descriptor of a multi until it is no longer signalled */
+static void drain_wakeup_fd (int fd)
+{
+   uint64_t count;
+
+   if (fd != -1)
+     (void) read (fd, &count, sizeof (count));
+}
+
+/* Wait up to dt seconds for activity on the transfers of the multi handle,
+ * but no longer than libcurl's own timeout.  curl_multi_poll and
+ * curl_multi_wait do not suffer from the FD_SETSIZE limitation of select,
+ * and curl_multi_poll waits even if libcurl has no sockets to wait upon.
+ * If wakeup_fd is not -1, it is the descriptor signalled by
+ * curl_multi_wakeup, which is included in the wait and drained.
+ */
+static int do_select_on_multi (CURLM *mhandle, int wakeup_fd, double dt)
+{
+#ifdef HAVE_CURL_MULTI_WAIT
+   long timeout_ms, curl_timeout_ms;
+   struct curl_waitfd extra_fd;
+   int numfds;
+#else
+   struct timeval tv;
+   fd_set read_fds, write_fds, execpt_fds;
+   int max_fd;
+   int ret;
+#endif
+   CURLMcode status;
+
+   /* Avoid a ridiculous wait period, 30 days ought to be enough */
+   if (dt > 30*86400)
+     dt = 30*86400;
+
+#ifdef HAVE_CURL_MULTI_WAIT
+   /* That is still too many milliseconds for an int */
+   if (dt * 1000.0 > (double) INT_MAX)
+     timeout_ms = INT_MAX;
+   else
+     timeout_ms = (long) (dt * 1000.0);
+   if (timeout_ms == 0)
+     timeout_ms = 1;
+
+   status = curl_multi_timeout (mhandle, &curl_timeout_ms);
+   if (status != CURLM_OK)
+     {
+	throw_multi_error (status);
+	return -1;
+     }
+   if (curl_timeout_ms == 0)
+     return 1;			       /* libcurl has something to do now */
+   if ((curl_timeout_ms > 0) && (curl_timeout_ms < timeout_ms))
+     timeout_ms = curl_timeout_ms;
+
+   memset ((char *) &extra_fd, 0, sizeof (extra_fd));
+   extra_fd.fd = wakeup_fd;
+   extra_fd.events = CURL_WAIT_POLLIN;
+
+   numfds = 0;
+# ifdef HAVE_CURL_MULTI_POLL
+   status = curl_multi_poll (mhandle, &extra_fd, (wakeup_fd != -1), (int) timeout_ms, &numfds);
+# else
+   status = curl_multi_wait (mhandle, &extra_fd, (wakeup_fd != -1), (int) timeout_ms, &numfds);
+# endif
+   if (status != CURLM_OK)
+     {
+	throw_multi_error (status);
+	return -1;
+     }
+   if (extra_fd.revents)
+     drain_wakeup_fd (wakeup_fd);
+   return numfds;
+#else
+   tv.tv_sec = (unsigned long) dt;
+   tv.tv_usec = (unsigned long) ((dt - tv.tv_sec) * 1e6);
+
+   FD_ZERO(&read_fds);
+   FD_ZERO(&write_fds);
+   FD_ZERO(&execpt_fds);
+
+   status  = curl_multi_fdset (mhandle, &read_fds, &write_fds, &execpt_fds, &max_fd);
+   if (status != CURLM_OK)
+     {
+	throw_multi_error (status);
+	return -1;
+     }
+   if ((wakeup_fd != -1) && (wakeup_fd < FD_SETSIZE))
+     {
+	FD_SET(wakeup_fd, &read_fds);
+	if (wakeup_fd > max_fd)
+	  max_fd = wakeup_fd;
+     }
+
+   ret = select (max_fd + 1, &read_fds, &write_fds, &execpt_fds, &tv);
+   if (ret == -1)
+     {
+	/* Pretend like something is available to read/write  */
+	ret = 1;
+     }
+   else if ((wakeup_fd != -1) && (wakeup_fd < FD_SETSIZE) && FD_ISSET(wakeup_fd, &read_fds))
+     drain_wakeup_fd (wakeup_fd);
+
+   return ret;
+#endif
+}
+
+/* The PERFORM_RUNNING flag of the multi applies to all of its handles
+ * via check_handle.
+ */
+static void set_multi_running (Multi_Type *m, int running)
+{
+   if (running)
+     m->flags |= PERFORM_RUNNING;
+   else
+     m->flags &= ~PERFORM_RUNNING;
+}
+
+static int multi_perform_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+   Easy_Type *ez;
+   CURLMcode status;
+   int running_handles, ret;
+   double dt = 0.0;
+
+   if (SLang_Num_Function_Args == 2)
+     {
+	if (-1 == SLang_pop_double (&dt))
+	  return -1;
+	if (dt < 0.0)
+	  dt = 0.0;
+     }
+
+   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     return -1;
+
+   ez = m->ez;
+   if (ez == NULL)
+     {
+	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type object has no handles");
+	SLang_free_mmt (mmt);
+	return -1;
+     }
+
+   set_multi_running (m, 1);
+
+   running_handles = 0;
+   dt = get_multi_wait (m, dt);
+   if (dt > 0.0)
+     {
+	ret = do_select_on_multi (m->mhandle, MULTI_WAKEUP_FD(m), dt);
+	if (ret == -1)
+	  running_handles = -1;
+     }
+
+   if (running_handles == 0) while (1)
+     {
+	status = curl_multi_perform (m->mhandle, &running_handles);
+	if (status == CURLM_CALL_MULTI_PERFORM)
+	  {
+	     if (0 != SLang_handle_interrupt ())
+	       break;
+
+	     continue;
+	  }
+
+	if (status != CURLM_OK)
+	  {
+	     throw_multi_error (status);
+	     break;
+	  }
+
+	/* Replace the transfers that have completed by queued ones */
+	ret = process_multi_transfers (m, running_handles);
+	if (ret > 0)
+	  continue;
+	if (ret == -1)
+	  running_handles = -1;
+	break;
+     }
+
+   set_multi_running (m, 0);
+
+   SLang_free_mmt (mmt);
+   if (running_handles == -1)
+     return -1;
+   return get_multi_pending (m);
+}
+
+/*{{{ Event driven interface */
+
+#ifdef HAVE_EPOLL
+# define MAX_EPOLL_EVENTS 256
+/* Wait up to dt seconds for socket activity, and pass only the sockets
+ * that are ready to libcurl.  This returns when a transfer has completed,
+ * dt seconds have elapsed, or curl_multi_wakeup has been called.
+ */
+static int do_multi_run (Multi_Type *m, double dt, int *running_handlesp)
+{
+   struct epoll_event events[MAX_EPOLL_EVENTS];
+   double now, deadline;
+   int last_running;
+   CURLMcode status;
+
+   now = get_monotonic_time ();
+   deadline = now + dt;
+   last_running = m->num_running;
+
+   while (1)
+     {
+	double wait_dt, wait_ms;
+	int i, n, woken = 0;
+
+	wait_dt = get_multi_wait (m, deadline - now);
+	if (m->timer_set && (m->timer_deadline - now < wait_dt))
+	  wait_dt = m->timer_deadline - now;
+	if (wait_dt < 0.0)
+	  wait_dt = 0.0;
+
+	wait_ms = wait_dt*1000.0 + 0.999;
+	if (wait_ms > (double) INT_MAX)
+	  wait_ms = (double) INT_MAX;
+
+	n = epoll_wait (m->epfd, events, MAX_EPOLL_EVENTS, (int) wait_ms);
+	if (n == -1)
+	  {
+	     if ((errno == EINTR) && (0 == SLang_handle_interrupt ()))
+	       n = 0;
+	     else
+	       {
+		  if (errno != EINTR)
+		    SLang_verror (Curl_Error, "epoll_wait failed: %s", strerror (errno));
+		  return -1;
+	       }
+	  }
+
+	status = CURLM_OK;
+	for (i = 0; (i < n) && (status == CURLM_OK); i++)
+	  {
+	     int ev_bitmask = 0;
+
+	     if (events[i].data.fd == m->wakeup_fd)
+	       {
+		  drain_wakeup_fd (m->wakeup_fd);
+		  woken = 1;
+		  continue;
+	       }
+
+	     if (events[i].events & EPOLLIN) ev_bitmask |= CURL_CSELECT_IN;
+	     if (events[i].events & EPOLLOUT) ev_bitmask |= CURL_CSELECT_OUT;
+	     if (events[i].events & (EPOLLERR|EPOLLHUP)) ev_bitmask |= CURL_CSELECT_ERR;
+	     status = curl_multi_socket_action (m->mhandle, events[i].data.fd, ev_bitmask, running_handlesp);
+	  }
+
+	now = get_monotonic_time ();
+	if ((status == CURLM_OK) && m->timer_set && (m->timer_deadline <= now))
+	  {
+	     m->timer_set = 0;
+	     status = curl_multi_socket_action (m->mhandle, CURL_SOCKET_TIMEOUT, 0, running_handlesp);
+	  }
+
+	if (status != CURLM_OK)
+	  {
+	     throw_multi_error (status);
+	     return -1;
+	  }
+
+	if (SLang_get_error ())
+	  return -1;
+
+	/* Replace the transfers that have completed by queued ones.  libcurl
+	 * starts them via the timer callback, so with CURLMOPT_MAX_RUNNING the
+	 * number of running transfers need not decrease: the completed ones
+	 * are found on the done list instead.
+	 */
+	if (-1 == process_multi_transfers (m, *running_handlesp))
+	  return -1;
+	*running_handlesp = m->num_running;
+
+	if ((*running_handlesp == 0)
+	    || (*running_handlesp < last_running)
+	    || (m->done_head != NULL)
+	    || woken
+	    || (now >= deadline))
+	  return 0;
+
+	last_running = *running_handlesp;
+     }
+}
+#endif				       /* HAVE_EPOLL */
+
+/* slang: Int_Type curl_multi_run (Curl_Multi_Type m [,Double_Type dt]) */
+static int multi_run_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+   int running_handles;
+   double dt = 0.0;
+
+   if (SLang_Num_Function_Args == 2)
+     {
+	if (-1 == SLang_pop_double (&dt))
+	  return -1;
+	if (dt < 0.0)
+	  dt = 0.0;
+	/* Avoid a ridiculous wait period, 30 days ought to be enough */
+	if (dt > 30*86400)
+	  dt = 30*86400;
+     }
+
+   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     return -1;
+
+   if (m->ez == NULL)
+     {
+	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type object has no handles");
+	SLang_free_mmt (mmt);
+	return -1;
+     }
+
+   set_multi_running (m, 1);
+   running_handles = m->num_running;
+#ifdef HAVE_EPOLL
+   if (-1 == do_multi_run (m, dt, &running_handles))
+     running_handles = -1;
+#else
+   /* Without epoll, fall back to curl_multi_perform */
+   dt = get_multi_wait (m, dt);
+   if ((dt > 0.0) && (-1 == do_select_on_multi (m->mhandle, MULTI_WAKEUP_FD(m), dt)))
+     running_handles = -1;
+   else
+     {
+	CURLMcode status;
+	while (CURLM_CALL_MULTI_PERFORM == (status = curl_multi_perform (m->mhandle, &running_handles)))
+	  {
+	     if (0 != SLang_handle_interrupt ())
+	       break;
+	  }
+	if ((status != CURLM_OK) && (status != CURLM_CALL_MULTI_PERFORM))
+	  {
+	     throw_multi_error (status);
+	     running_handles = -1;
+	  }
+	else if (-1 == process_multi_transfers (m, running_handles))
+	  running_handles = -1;
+     }
+#endif
+   set_multi_running (m, 0);
+
+   SLang_free_mmt (mmt);
+   if (running_handles == -1)
+     return -1;
+   return get_multi_pending (m);
+}
+
+/*}}}*/
+
+/* Remove the oldest transfer from the done list */
+static Easy_Type *pop_done_handle (Multi_Type *m)
+{
+   Easy_Type *ez = m->done_head;
+
+   if (ez == NULL)
+     return NULL;
+   unlink_done_handle (m, ez);
+   return ez;
+}
+
+static void multi_info_read (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+   Easy_Type *ez;
+   SLang_Ref_Type *ref = NULL;
+
+   if (SLang_Num_Function_Args == 2)
+     {
+	if (-1 == SLang_pop_ref (&ref))
+	  return;
+     }
+
+   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     {
+	SLang_free_ref (ref);
+	return;
+     }
+
+   if ((-1 != collect_multi_messages (m))
+       && (NULL != (ez = pop_done_handle (m))))
+     {
+	CURLcode status = ez->done_status;
+
+	if ((-1 == end_transfer (ez, status == CURLE_OK))
+	    && (status == CURLE_OK))
+	  status = CURLE_WRITE_ERROR;
+
+	if (ref != NULL)
+	  {
+	     int i = (int) status;
+	     if (-1 == SLang_assign_to_ref (ref, SLANG_INT_TYPE, (VOID_STAR)&i))
+	       goto free_return;
+	  }
+	(void) SLang_push_mmt (ez->mmt);
+	goto free_return;
+     }
+
+   (void) SLang_push_null ();
+
+   free_return:
+
+   if (ref != NULL)
+     SLang_free_ref (ref);
+   SLang_free_mmt (mmt);
+}
+
+/* slang: (handles, status, codes, times) = curl_multi_info_read_all (m);
+ *
+ * This drains all of the completed transfers at once, and returns parallel
+ * arrays of the Curl_Type objects, their completion status, the response
+ * codes, and the total transfer times.
+ */
+static void multi_info_read_all (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+   Easy_Type *ez;
+   Easy_Type **ezs = NULL;
+   int *results = NULL;
+   SLindex_Type i, num = 0, max_num = 0;
+   SLang_Array_Type *at_handles = NULL, *at_results = NULL, *at_codes = NULL, *at_times = NULL;
+
+   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     return;
+
+   if (-1 == collect_multi_messages (m))
+     goto free_return;
+
+   while (m->done_head != NULL)
+     {
+	CURLcode status;
+
+	if (num == max_num)
+	  {
+	     SLindex_Type new_max = 2*num + 16;
+	     Easy_Type **new_ezs;
+	     int *new_results;
+
+	     if (NULL == (new_ezs = (Easy_Type **) SLrealloc ((char *) ezs, new_max * sizeof (Easy_Type *))))
+	       goto free_return;
+	     ezs = new_ezs;
+	     if (NULL == (new_results = (int *) SLrealloc ((char *) results, new_max * sizeof (int))))
+	       goto free_return;
+	     results = new_results;
+	     max_num = new_max;
+	  }
+
+	ez = pop_done_handle (m);
+	status = ez->done_status;
+	if ((-1 == end_transfer (ez, status == CURLE_OK))
+	    && (status == CURLE_OK))
+	  status = CURLE_WRITE_ERROR;
 
-      case CURLOPT_MAXFILESIZE:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
-      case CURLOPT_MAXFILESIZE_LARGE:
-	break;			       /* FIXME: curl_off_t */
+	ezs[num] = ez;
+	results[num] = (int) status;
+	num++;
+     }
 
-      case CURLOPT_TIMECONDITION:      /* FIXME: specific values */
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   if ((NULL == (at_handles = SLang_create_array (Easy_Type_Id, 0, NULL, &num, 1)))
+       || (NULL == (at_results = SLang_create_array (SLANG_INT_TYPE, 0, NULL, &num, 1)))
+       || (NULL == (at_codes = SLang_create_array (SLANG_INT_TYPE, 0, NULL, &num, 1)))
+       || (NULL == (at_times = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, &num, 1))))
+     goto free_return;
 
-      case CURLOPT_TIMEVALUE:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   for (i = 0; i < num; i++)
+     {
+	long code = 0;
+	double t = 0.0;
+
+	ez = ezs[i];
+	(void) curl_easy_getinfo (ez->handle, CURLINFO_RESPONSE_CODE, &code);
+	(void) curl_easy_getinfo (ez->handle, CURLINFO_TOTAL_TIME, &t);
+
+	SLang_inc_mmt (ez->mmt);
+	((SLang_MMT_Type **) at_handles->data)[i] = ez->mmt;
+	((int *) at_results->data)[i] = results[i];
+	((int *) at_codes->data)[i] = (int) code;
+	((double *) at_times->data)[i] = t;
+     }
 
-	/* Connection options */
-      case CURLOPT_TIMEOUT:
-      case CURLOPT_LOW_SPEED_LIMIT:
-      case CURLOPT_LOW_SPEED_TIME:
-      case CURLOPT_MAXCONNECTS:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   (void) SLang_push_array (at_handles, 1);
+   (void) SLang_push_array (at_results, 1);
+   (void) SLang_push_array (at_codes, 1);
+   (void) SLang_push_array (at_times, 1);
+   at_handles = at_results = at_codes = at_times = NULL;
 
-      case CURLOPT_CLOSEPOLICY:	       /* FIXME: specific values */
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   free_return:
+   if (at_handles != NULL) SLang_free_array (at_handles);
+   if (at_results != NULL) SLang_free_array (at_results);
+   if (at_codes != NULL) SLang_free_array (at_codes);
+   if (at_times != NULL) SLang_free_array (at_times);
+   if (ezs != NULL) SLfree ((char *) ezs);
+   if (results != NULL) SLfree ((char *) results);
+   SLang_free_mmt (mmt);
+}
 
-      case CURLOPT_FORBID_REUSE:       /* may want to avoid this */
-#if 0
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+#ifdef HAVE_CURL_MULTI_WAKEUP
+/* This makes the next or current wait of curl_multi_perform or
+ * curl_multi_run return early.  Since S-Lang code only runs between waits,
+ * it is mainly useful from a callback that has made more work available.
+ */
+static void multi_wakeup_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+#ifdef HAVE_EPOLL
+   uint64_t one = 1;
 #else
-	break;
+   CURLMcode status;
 #endif
 
-      case CURLOPT_CONNECTTIMEOUT:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   if (NULL == (mmt = pop_multi_type (&m, 0)))
+     return;
 
-      case CURLOPT_IPRESOLVE:	       /* FIXME: specific values */
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+#ifdef HAVE_EPOLL
+   /* Both drivers wait upon the eventfd and drain it.  libcurl's own
+    * wakeup is not used since curl_multi_run would never drain it.  The
+    * eventfd is already signalled if its counter is full.
+    */
+   (void) write (m->wakeup_fd, &one, sizeof (one));
+#else
+   status = curl_multi_wakeup (m->mhandle);
+   if (status != CURLM_OK)
+     throw_multi_error (status);
+#endif
 
-	/* SSL and Security Options */
-      case CURLOPT_SSLCERT:
-      case CURLOPT_SSLCERTTYPE:
-      /* case CURLOPT_SSLCERTPASSWD: */
-      case CURLOPT_SSLKEY:
-      case CURLOPT_SSLKEYTYPE:
-      case CURLOPT_SSLKEYPASSWD:
-      case CURLOPT_SSLENGINE:
-      case CURLOPT_SSLENGINE_DEFAULT:
-	return set_string_opt (ez, opt, nargs);
+   SLang_free_mmt (mmt);
+}
+#endif
 
-      case CURLOPT_SSL_VERIFYPEER:
-	return set_long_opt (ez, opt, nargs, 1, 1L);
+/* slang: curl_multi_setopt (m, option, [host,] rate [,burst])
+ *
+ * The host may only be given for the per-host limits.  Without it, the
+ * limit applies to every host that has no limit of its own.
+ */
+static int set_rate_limit_opt (Multi_Type *m, int opt, int nargs)
+{
+   Rate_Limit_Type limit, *l;
+   Token_Bucket_Type *b = NULL;
+   Multi_Host_Type *h = NULL;
+   char *host, name[256];
+   int is_request = ((opt == CURLMOPT_MAX_REQUEST_RATE) || (opt == CURLMOPT_MAX_HOST_REQUEST_RATE));
+
+   if (((opt == CURLMOPT_MAX_HOST_REQUEST_RATE) || (opt == CURLMOPT_MAX_HOST_BYTE_RATE))
+       && (nargs > 1) && (SLang_peek_at_stack () == SLANG_STRING_TYPE))
+     {
+	if (-1 == SLang_pop_slstring (&host))
+	  return -1;
+	get_url_host (host, name, sizeof (name));
+	SLang_free_slstring (host);
+	if (NULL == (h = get_multi_host (m, name, 1)))
+	  return -1;
+	nargs--;
+     }
 
-      case CURLOPT_SSLVERSION:	       /* FIXME: specific values */
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   if ((nargs < 1) || (nargs > 2))
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a rate, and optionally a burst size");
+	return -1;
+     }
+   limit.burst = 0.0;
+   if ((-1 == SLang_pop_double (&limit.rate))
+       || ((nargs == 2) && (-1 == SLang_pop_double (&limit.burst))))
+     return -1;
 
-      case CURLOPT_CAINFO:
-      case CURLOPT_CAPATH:
-#ifdef HAVE_CURLOPT_RANDOM_FILE
-      case CURLOPT_RANDOM_FILE:
-#endif
-#ifdef HAVE_CURLOPT_EGDSOCKET
-      case CURLOPT_EGDSOCKET:
-#endif
-	return set_string_opt (ez, opt, nargs);
+   /* A negative rate removes the limit of a host so that the default applies */
+   if (limit.rate < 0.0)
+     limit.rate = (h != NULL) ? -1.0 : 0.0;
+   if (limit.burst <= 0.0)
+     limit.burst = limit.rate;
+   if (is_request && (limit.burst < 1.0))
+     limit.burst = 1.0;
 
-      case CURLOPT_SSL_VERIFYHOST:
-	return set_long_opt (ez, opt, nargs, 0, 0L);
+   switch (opt)
+     {
+      case CURLMOPT_MAX_REQUEST_RATE:
+	l = &m->request_limit;
+	b = &m->request_bucket;
+	break;
+      case CURLMOPT_MAX_BYTE_RATE:
+	l = &m->byte_limit;
+	b = &m->byte_bucket;
+	break;
+      case CURLMOPT_MAX_HOST_REQUEST_RATE:
+	l = (h != NULL) ? &h->request_limit : &m->host_request_limit;
+	if (h != NULL) b = &h->request_bucket;
+	break;
+      default:
+	l = (h != NULL) ? &h->byte_limit : &m->host_byte_limit;
+	if (h != NULL) b = &h->byte_bucket;
+	break;
+     }
 
-      case CURLOPT_SSL_CIPHER_LIST:    /* FIXME: check syntax */
-	return set_string_opt (ez, opt, nargs);
+   *l = limit;
+   if (b != NULL)
+     b->last = 0.0;		       /* start with a full bucket */
+   if (limit.rate > 0.0)
+     m->rate_limited = 1;
 
-      case CURLOPT_KRB4LEVEL:
-	return set_string_opt (ez, opt, nargs);
+   /* The new limit may allow more transfers to run */
+   return (-1 == admit_queued_handles (m)) ? -1 : 0;
+}
 
-	/* Misc */
-      case CURLOPT_PRIVATE:	       /* FIXME: provide interface?? */
-	break;
+/* Multi options that are implemented by the module itself */
+static int do_module_multi_setopt (Multi_Type *m, int opt, int nargs)
+{
+   Multi_Host_Type *h;
+   char *host, name[256];
+   double weight;
+   int ival;
 
-	/* Telnet Options */
-      case CURLOPT_TELNETOPTIONS:      /* FIXME: linked list */
-	break;
+   switch (opt)
+     {
+      case CURLMOPT_MAX_RUNNING:
+	if (nargs != 1)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Expecting a single value for CURLMOPT_MAX_RUNNING");
+	     return -1;
+	  }
+	if (-1 == SLang_pop_int (&ival))
+	  return -1;
+	m->max_running = (ival > 0) ? (unsigned int) ival : 0;
+	/* The new limit may allow more transfers to run */
+	return (-1 == admit_queued_handles (m)) ? -1 : 0;
+
+      case CURLMOPT_HOST_WEIGHT:
+	if (nargs != 2)
+	  {
+	     SLang_verror (SL_INVALID_PARM, "Expecting a host and a weight for CURLMOPT_HOST_WEIGHT");
+	     return -1;
+	  }
+	if (-1 == SLang_pop_slstring (&host))
+	  return -1;
+	if (-1 == SLang_pop_double (&weight))
+	  {
+	     SLang_free_slstring (host);
+	     return -1;
+	  }
+	get_url_host (host, name, sizeof (name));
+	SLang_free_slstring (host);
+	if (!(weight > 0.0))
+	  {
+	     SLang_verror (SL_INVALID_PARM, "The weight of a host must be positive");
+	     return -1;
+	  }
+	if (NULL == (h = get_multi_host (m, name, 1)))
+	  return -1;
+	h->weight = weight;
+	return 0;
+
+      case CURLMOPT_MAX_REQUEST_RATE:
+      case CURLMOPT_MAX_BYTE_RATE:
+      case CURLMOPT_MAX_HOST_REQUEST_RATE:
+      case CURLMOPT_MAX_HOST_BYTE_RATE:
+	return set_rate_limit_opt (m, opt, nargs);
 
       default:
 	break;
      }
-   SLang_verror (SL_INVALID_PARM, "cURL option is unknown or unsupported");
+   SLang_verror (SL_INVALID_PARM, "cURL multi option is unknown or unsupported");
    return -1;
 }
 
-static void setopt_intrin (void)
+static int do_multi_setopt (Multi_Type *m, int opt, int nargs)
+{
+   CURLMcode status;
+   long val;
+
+   if (opt >= MODULE_OPT_BASE)
+     return do_module_multi_setopt (m, opt, nargs);
+
+   switch (opt)
+     {
+#ifdef HAVE_CURLMOPT_PIPELINING
+      case CURLMOPT_PIPELINING:
+#endif
+#ifdef HAVE_CURLMOPT_MAXCONNECTS
+      case CURLMOPT_MAXCONNECTS:
+#endif
+#ifdef HAVE_CURLMOPT_MAX_HOST_CONNECTIONS
+      case CURLMOPT_MAX_HOST_CONNECTIONS:
+#endif
+#ifdef HAVE_CURLMOPT_MAX_TOTAL_CONNECTIONS
+      case CURLMOPT_MAX_TOTAL_CONNECTIONS:
+#endif
+#ifdef HAVE_CURLMOPT_MAX_CONCURRENT_STREAMS
+      case CURLMOPT_MAX_CONCURRENT_STREAMS:
+#endif
+	break;
+
+      default:
+	SLang_verror (SL_INVALID_PARM, "cURL multi option is unknown or unsupported");
+	return -1;
+     }
+
+   if (nargs != 1)
+     {
+	SLang_verror (SL_INVALID_PARM, "Expecting a single value for this cURL multi option");
+	return -1;
+     }
+   if (-1 == SLang_pop_long (&val))
+     return -1;
+
+   status = curl_multi_setopt (m->mhandle, (CURLMoption) opt, val);
+   if (status != CURLM_OK)
+     {
+	throw_multi_error (status);
+	return -1;
+     }
+   return 0;
+}
+
+/* slang: curl_multi_setopt (Curl_Multi_Type m, Int_Type option, value) */
+static void multi_setopt_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+   int opt;
+   int nargs = SLang_Num_Function_Args - 2;
+
+   if (nargs < 0)
+     {
+	SLang_verror (SL_USAGE_ERROR, "Usage: curl_multi_setopt(multiobj, option, value)");
+	return;
+     }
+
+   if (-1 == SLreverse_stack (nargs + 2))
+     return;
+
+   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+     return;
+
+   if (-1 == SLang_pop_int (&opt))
+     {
+	SLang_free_mmt (mmt);
+	return;
+     }
+
+   (void) do_multi_setopt (m, opt, nargs);
+   SLang_free_mmt (mmt);
+}
+
+static void new_multi_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+
+   if (NULL == (m = (Multi_Type *) SLcalloc (1, sizeof (Multi_Type))))
+     return;
+
+#ifdef HAVE_EPOLL
+   m->epfd = -1;
+   m->wakeup_fd = -1;
+#endif
+   if (NULL == (m->mhandle = curl_multi_init ()))
+     {
+	SLang_verror (Curl_Error, "curl_multi_init failed");
+	free_multi_type (m);
+	return;
+     }
+
+#ifdef HAVE_EPOLL
+   if (-1 == init_multi_events (m))
+     {
+	free_multi_type (m);
+	return;
+     }
+#endif
+
+   if (NULL == (mmt = SLang_create_mmt (Multi_Type_Id, (VOID_STAR) m)))
+     {
+	free_multi_type (m);
+	return;
+     }
+
+   if (-1 == SLang_push_mmt (mmt))
+     SLang_free_mmt (mmt);
+}
+
+static int get_multi_length_intrin (void)
+{
+   SLang_MMT_Type *mmt;
+   Multi_Type *m;
+   int len;
+
+   if (NULL == (mmt = pop_multi_type (&m, 0)))
+     return -1;
+
+   len = m->length;
+   SLang_free_mmt (mmt);
+   return len;
+}
+
+/*}}}*/
+
+/*{{{ curl_fetch_many */
+
+/* curl_fetch_many keeps a fixed number of easy handles, and reuses each
+ * one for the next URL as soon as its transfer is done.  No S-Lang code
+ * is executed during the transfers.
+ */
+typedef struct
+{
+   CURL *handle;
+   SLindex_Type index;		       /* of the URL being fetched */
+   Byte_Buffer_Type body;
+}
+Fetch_Slot_Type;
+
+typedef struct
+{
+   int parallel;
+   long timeout_ms;
+   long connect_timeout_ms;
+   int follow;
+   char *useragent;
+}
+Fetch_Options_Type;
+
+static size_t fetch_write_function (char *data, size_t size, size_t nmemb, VOID_STAR clientp)
+{
+   Fetch_Slot_Type *slot = (Fetch_Slot_Type *) clientp;
+   Byte_Buffer_Type *b = &slot->body;
+   size_t len = size * nmemb;
+
+   if (b->len == 0)
+     {
+	curl_off_t clen = get_content_length (slot->handle);
+	if ((clen > 0) && (clen <= MAX_BODY_PRESIZE)
+	    && (-1 == reserve_byte_buffer (b, (size_t) clen)))
+	  return 0;
+     }
+
+   if (-1 == append_byte_buffer (b, (unsigned char *) data, len))
+     return 0;
+
+   return len;
+}
+
+static int get_fetch_options (Fetch_Options_Type *opts)
+{
+   double t;
+
+   memset ((char *) opts, 0, sizeof (Fetch_Options_Type));
+#if SLANG_VERSION >= 20100
+   if (-1 == SLang_get_int_qualifier ("parallel", &opts->parallel, 16))
+     return -1;
+   if (-1 == SLang_get_double_qualifier ("timeout", &t, 0.0))
+     return -1;
+   opts->timeout_ms = (long) (t * 1000.0);
+   if (-1 == SLang_get_double_qualifier ("connect_timeout", &t, 0.0))
+     return -1;
+   opts->connect_timeout_ms = (long) (t * 1000.0);
+   if (-1 == SLang_get_int_qualifier ("follow", &opts->follow, 0))
+     return -1;
+   if (-1 == SLang_get_string_qualifier ("useragent", &opts->useragent, NULL))
+     return -1;
+#else
+   (void) t;
+   opts->parallel = 16;
+#endif
+   if (opts->parallel < 1)
+     opts->parallel = 1;
+   return 0;
+}
+
+static int init_fetch_slot (Fetch_Slot_Type *slot, Fetch_Options_Type *opts)
 {
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
-   int opt;
-   int nargs = SLang_Num_Function_Args - 2;
+   CURL *handle;
 
-   if (nargs < 0)
+   if (NULL == (handle = curl_easy_init ()))
      {
-	SLang_verror (SL_USAGE_ERROR, "Usage: curl_setopt(curlobj, option, value)");
-	return;
+	SLang_verror (Curl_Error, "curl_easy_init failed");
+	return -1;
      }
+   slot->handle = handle;
+
+   if ((CURLE_OK != curl_easy_setopt (handle, CURLOPT_WRITEFUNCTION, fetch_write_function))
+       || (CURLE_OK != curl_easy_setopt (handle, CURLOPT_WRITEDATA, (void *) slot))
+       || (CURLE_OK != curl_easy_setopt (handle, CURLOPT_PRIVATE, (void *) slot))
+       || (CURLE_OK != curl_easy_setopt (handle, CURLOPT_NOSIGNAL, 1L))
+       || (CURLE_OK != curl_easy_setopt (handle, CURLOPT_FOLLOWLOCATION, (long) opts->follow))
+       || (opts->timeout_ms
+	   && (CURLE_OK != curl_easy_setopt (handle, CURLOPT_TIMEOUT_MS, opts->timeout_ms)))
+       || (opts->connect_timeout_ms
+	   && (CURLE_OK != curl_easy_setopt (handle, CURLOPT_CONNECTTIMEOUT_MS, opts->connect_timeout_ms)))
+       || ((opts->useragent != NULL)
+	   && (CURLE_OK != curl_easy_setopt (handle, CURLOPT_USERAGENT, opts->useragent))))
+     {
+	SLang_verror (Curl_Error, "Unable to configure a handle for curl_fetch_many");
+	return -1;
+     }
+   return 0;
+}
 
-   if (-1 == SLreverse_stack (nargs + 2))
-     return;
-
-   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
-     return;
+/* Start the transfer of the next URL on the slot.  NULL URLs are skipped
+ * and reported as malformed.  Returns 1 if a transfer was started, 0 if
+ * there are no more URLs, or -1 upon error.
+ */
+static int start_next_fetch (CURLM *mh, Fetch_Slot_Type *slot,
+			     char **urls, SLindex_Type num, SLindex_Type *nextp,
+			     int *results)
+{
+   CURLMcode status;
 
-   if (-1 == SLang_pop_int (&opt))
+   while (*nextp < num)
      {
-	SLang_free_mmt (mmt);
-	return;
-     }
+	SLindex_Type i = (*nextp)++;
 
-   (void) do_setopt (ez, (CURLoption)opt, nargs);
+	if (urls[i] == NULL)
+	  {
+	     results[i] = (int) CURLE_URL_MALFORMAT;
+	     continue;
+	  }
 
-   SLang_free_mmt (mmt);
+	if (CURLE_OK != curl_easy_setopt (slot->handle, CURLOPT_URL, urls[i]))
+	  {
+	     results[i] = (int) CURLE_URL_MALFORMAT;
+	     continue;
+	  }
+
+	slot->index = i;
+	status = curl_multi_add_handle (mh, slot->handle);
+	if (status != CURLM_OK)
+	  {
+	     throw_multi_error (status);
+	     return -1;
+	  }
+	return 1;
+     }
+   return 0;
 }
 
-static void new_curl_intrin (char *url)
+/* slang: (bodies, status, codes, times) = curl_fetch_many (String_Type urls[]
+ *          ; parallel=16, timeout=0, connect_timeout=0, follow=0, useragent=NULL);
+ */
+static void fetch_many_intrin (void)
 {
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
-   CURLcode status;
-
-   if (NULL == (ez = (Easy_Type *) SLcalloc (1, sizeof (Easy_Type))))
+   SLang_Array_Type *at_urls = NULL;
+   SLang_Array_Type *at_bodies = NULL, *at_results = NULL, *at_codes = NULL, *at_times = NULL;
+   Fetch_Options_Type opts;
+   Fetch_Slot_Type *slots = NULL;
+   CURLM *mh = NULL;
+   char **urls;
+   int *results;
+   SLindex_Type num, next;
+   int i, nslots = 0, active = 0;
+
+   if (-1 == get_fetch_options (&opts))
      return;
 
-   if (NULL == (ez->handle = curl_easy_init ()))
-     {
-	SLang_verror (SL_RunTime_Error, "curl_easy_init failed");
-	free_easy_type (ez);
-	return;
-     }
+   if (-1 == SLang_pop_array_of_type (&at_urls, SLANG_STRING_TYPE))
+     goto free_return;
 
-   if (NULL == (ez->url = SLang_create_slstring (url)))
-     {
-	free_easy_type (ez);
-	return;
-     }
+   num = (SLindex_Type) at_urls->num_elements;
+   urls = (char **) at_urls->data;
 
-   if (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_ERRORBUFFER, ez->errbuf)))
+   if ((NULL == (at_bodies = SLang_create_array (SLANG_BSTRING_TYPE, 0, NULL, &num, 1)))
+       || (NULL == (at_results = SLang_create_array (SLANG_INT_TYPE, 0, NULL, &num, 1)))
+       || (NULL == (at_codes = SLang_create_array (SLANG_INT_TYPE, 0, NULL, &num, 1)))
+       || (NULL == (at_times = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, &num, 1))))
+     goto free_return;
+   results = (int *) at_results->data;
+
+   if (NULL == (mh = curl_multi_init ()))
      {
-	SLang_verror (SL_RunTime_Error, "curl_easy_setopt: %s", curl_easy_strerror (status));
-	free_easy_type (ez);
-	return;
+	SLang_verror (Curl_Error, "curl_multi_init failed");
+	goto free_return;
      }
 
-   if (NULL == (mmt = SLang_create_mmt (Easy_Type_Id, (VOID_STAR) ez)))
+   nslots = (num < opts.parallel) ? (int) num : opts.parallel;
+   if ((nslots > 0)
+       && (NULL == (slots = (Fetch_Slot_Type *) SLcalloc (nslots, sizeof (Fetch_Slot_Type)))))
      {
-	free_easy_type (ez);
-	return;
+	nslots = 0;
+	goto free_return;
      }
-   ez->mmt = mmt;
 
-   if (-1 == set_string_opt_internal (ez, CURLOPT_URL, url))
+   next = 0;
+   for (i = 0; i < nslots; i++)
      {
-	SLang_free_mmt (mmt);
-	return;
+	int ret;
+
+	if (-1 == init_fetch_slot (&slots[i], &opts))
+	  goto free_return;
+	if (-1 == (ret = start_next_fetch (mh, &slots[i], urls, num, &next, results)))
+	  goto free_return;
+	active += ret;
      }
 
-   if ((CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_VERBOSE, 0L)))
-       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_NOPROGRESS, 1L)))
-       || (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_PRIVATE, (char *)ez))))
+   while (active > 0)
      {
-	SLang_verror (Curl_Error, "curl_easy_setopt: %s", curl_easy_strerror (status));
-	SLang_free_mmt (mmt);
-	return;
-     }
+	CURLMcode mstatus;
+	CURLMsg *msg;
+	int running_handles, msgs_in_queue;
 
-   if (-1 == SLang_push_mmt (mmt))
-     SLang_free_mmt (mmt);
-}
+	while (CURLM_CALL_MULTI_PERFORM == (mstatus = curl_multi_perform (mh, &running_handles)))
+	  ;
+	if (mstatus != CURLM_OK)
+	  {
+	     throw_multi_error (mstatus);
+	     goto free_return;
+	  }
 
-static void perform_intrin (void)
-{
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
-   CURLcode status;
+	while (NULL != (msg = curl_multi_info_read (mh, &msgs_in_queue)))
+	  {
+	     Fetch_Slot_Type *slot;
+	     SLindex_Type j;
+	     long code = 0;
+	     double t = 0.0;
+	     int ret;
 
-   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
-     return;
+	     if (msg->msg != CURLMSG_DONE)
+	       continue;
 
-   ez->flags |= PERFORM_RUNNING;
-   if (CURLE_OK != (status = curl_easy_perform (ez->handle)))
-     throw_curl_error (status, ez->errbuf);
-   ez->flags &= ~PERFORM_RUNNING;
+	     if ((CURLE_OK != curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (char **)&slot))
+		 || (slot == NULL))
+	       {
+		  SLang_verror (Curl_Error, "Internal cURL error");
+		  goto free_return;
+	       }
+	     j = slot->index;
+	     results[j] = (int) msg->data.result;
+	     (void) curl_easy_getinfo (slot->handle, CURLINFO_RESPONSE_CODE, &code);
+	     (void) curl_easy_getinfo (slot->handle, CURLINFO_TOTAL_TIME, &t);
+	     ((int *) at_codes->data)[j] = (int) code;
+	     ((double *) at_times->data)[j] = t;
+
+	     if (results[j] == CURLE_OK)
+	       {
+		  SLang_BString_Type *bstr = byte_buffer_to_bstring (&slot->body);
+		  if (bstr == NULL)
+		    goto free_return;
+		  ((SLang_BString_Type **) at_bodies->data)[j] = bstr;
+	       }
+	     free_byte_buffer (&slot->body);
 
-   SLang_free_mmt (mmt);
-}
+	     (void) curl_multi_remove_handle (mh, slot->handle);
+	     active--;
 
-static void close_intrin (void)
-{
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
+	     if (-1 == (ret = start_next_fetch (mh, slot, urls, num, &next, results)))
+	       goto free_return;
+	     active += ret;
+	  }
 
-   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
-     return;
+	if (active == 0)
+	  break;
 
-   if (ez->multi != NULL)
-     {
-	SLang_verror (SL_INVALID_PARM, "The object must first be removed from the Curl_Multi_Type before it can be closed");
-	SLang_free_mmt (mmt);
-	return;
+	if ((0 != SLang_handle_interrupt ())
+	    || (-1 == do_select_on_multi (mh, -1, 1.0)))
+	  goto free_return;
      }
 
-   curl_easy_cleanup (ez->handle);
-   ez->handle = NULL;
+   (void) SLang_push_array (at_bodies, 1);
+   (void) SLang_push_array (at_results, 1);
+   (void) SLang_push_array (at_codes, 1);
+   (void) SLang_push_array (at_times, 1);
+   at_bodies = at_results = at_codes = at_times = NULL;
 
-   SLang_free_mmt (mmt);
+   free_return:
+   for (i = 0; i < nslots; i++)
+     {
+	if (slots[i].handle == NULL)
+	  continue;
+	(void) curl_multi_remove_handle (mh, slots[i].handle);
+	curl_easy_cleanup (slots[i].handle);
+	free_byte_buffer (&slots[i].body);
+     }
+   if (slots != NULL) SLfree ((char *) slots);
+   if (mh != NULL) (void) curl_multi_cleanup (mh);
+   if (at_bodies != NULL) SLang_free_array (at_bodies);
+   if (at_results != NULL) SLang_free_array (at_results);
+   if (at_codes != NULL) SLang_free_array (at_codes);
+   if (at_times != NULL) SLang_free_array (at_times);
+   if (at_urls != NULL) SLang_free_array (at_urls);
+   if (opts.useragent != NULL) SLang_free_slstring (opts.useragent);
 }
 
-static void get_url_intrin (void)
-{
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
+/*}}}*/
 
-   if (NULL == (mmt = pop_easy_type (&ez, 0)))
-     return;
+/*{{{ Asynchronous transfers */
 
-   (void) SLang_push_string (ez->url);
-   SLang_free_mmt (mmt);
+#ifdef HAVE_ASYNC
+/* Transfers started by curl_perform_async are carried out by a number of
+ * shards.  Each shard is a thread that drives its own multi handle, so
+ * that the libcurl and TLS work is spread over the available cores.  Only
+ * handles without S-Lang callbacks are accepted so that the shards never
+ * execute S-Lang code.  The buffers of the native sinks are switched to
+ * malloc for the same reason.
+ *
+ * A submitted transfer is placed on the pending queue of the least loaded
+ * shard.  A shard that has no pending transfers of its own and room for
+ * more steals them from the shard with the longest queue.  A completed
+ * transfer is pushed onto a lock-free stack of the shard, from which the
+ * interpreter collects it using curl_async_poll or curl_async_wait.  A
+ * pipe is used to wake up the latter.  The shards share DNS and TLS
+ * session data.
+ */
+#define ASYNC_MAX_SHARDS 64
+#define ASYNC_SHARD_MAX_RUNNING 512
+
+typedef struct
+{
+   pthread_mutex_t mutex;	       /* protects the pending queue */
+   Easy_Type *head, *tail;	       /* submitted but not yet started */
+   unsigned int num_pending;
+   unsigned int num_running;	       /* written only by the shard */
+   Easy_Type *done;		       /* completed transfers, newest first */
+   CURLM *mhandle;
+   pthread_t thread;
 }
+Async_Shard_Type;
 
-static int push_slist (struct curl_slist *slist)
+typedef struct
 {
-   SLindex_Type num;
-   struct curl_slist *s;
-   SLang_Array_Type *at;
-   char **data;
+   int initialized;
+   int stop;			       /* set to make the shards exit */
+   unsigned int num_shards;	       /* shards with a running thread */
+   unsigned int max_shards;	       /* shards allocated */
+   Async_Shard_Type *shards;
+   unsigned int num_outstanding;       /* used only by the interpreter */
+   int wakeup_fds[2];
+   CURLSH *shandle;
+   pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+}
+Async_Pool_Type;
 
-   if (slist == NULL)
-     return SLang_push_null ();
+static Async_Pool_Type Async_Pool;
 
-   num = 0;
-   s = slist;
-   while (s != NULL)
+static void push_async_done (Async_Shard_Type *shard, Easy_Type *ez)
+{
+   Easy_Type *head = __atomic_load_n (&shard->done, __ATOMIC_RELAXED);
+
+   do
+     ez->async_next = head;
+   while (0 == __atomic_compare_exchange_n (&shard->done, &head, ez, 1,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+   /* Only a transition from empty needs to wake up the interpreter */
+   if (head == NULL)
      {
-	num++;
-	s = s->next;
+	char ch = 0;
+	while ((-1 == write (Async_Pool.wakeup_fds[1], &ch, 1)) && (errno == EINTR))
+	  ;
      }
+}
 
-   at = SLang_create_array (SLANG_STRING_TYPE, 0, NULL, &num, 1);
-   if (at == NULL)
-     return -1;
+/* Returns the completed transfers of all shards.  Those of each shard are
+ * in the order of completion.
+ */
+static Easy_Type *take_async_done (void)
+{
+   Easy_Type *fifo = NULL;
+   unsigned int i;
+   char buf[64];
 
-   data = (char **) at->data;
-   s = slist;
-   while (s != NULL)
+   /* The pipe must be drained first so that a wakeup for a transfer that
+    * completes after the exchange is not lost.
+    */
+   while (0 < read (Async_Pool.wakeup_fds[0], buf, sizeof (buf)))
+     ;
+
+   for (i = Async_Pool.num_shards; i > 0; i--)
      {
-	if ((slist->data != NULL)
-	    && (NULL == (*data = SLang_create_slstring (slist->data))))
+	Easy_Type *list = __atomic_exchange_n (&Async_Pool.shards[i-1].done, NULL, __ATOMIC_ACQUIRE);
+	while (list != NULL)
 	  {
-	     SLang_free_array (at);
-	     return -1;
+	     Easy_Type *next = list->async_next;
+	     list->async_next = fifo;
+	     fifo = list;
+	     list = next;
 	  }
-	data++;
-	s = s->next;
      }
-   return SLang_push_array (at, 1);
+   return fifo;
 }
 
-static void get_info_intrin (void)
+static unsigned int get_shard_load (Async_Shard_Type *shard)
 {
-   SLang_MMT_Type *mmt;
-   Easy_Type *ez;
-   CURLcode status;
-   char *str;
-   long lvar;
-   double dvar;
-   struct curl_slist *slist;
-   int info;
-
-   if (-1 == SLang_pop_int (&info))
-     return;
+   return __atomic_load_n (&shard->num_pending, __ATOMIC_RELAXED)
+     + __atomic_load_n (&shard->num_running, __ATOMIC_RELAXED);
+}
 
-   if (NULL == (mmt = pop_easy_type (&ez, 0)))
-     return;
+/* Remove up to max transfers from the front of the pending queue */
+static Easy_Type *take_pending (Async_Shard_Type *shard, unsigned int max)
+{
+   Easy_Type *list, *last;
+   unsigned int n;
 
-   switch ((CURLINFO) info)
+   (void) pthread_mutex_lock (&shard->mutex);
+   list = last = shard->head;
+   n = (list == NULL) ? 0 : 1;
+   while ((n < max) && (last != NULL) && (last->async_next != NULL))
      {
-      case CURLINFO_EFFECTIVE_URL:
-      case CURLINFO_CONTENT_TYPE:
-	status = curl_easy_getinfo (ez->handle, info, &str);
-	if (status == CURLE_OK)
-	  (void) SLang_push_string (str);
-	break;
-
-      case CURLINFO_RESPONSE_CODE:
-      case CURLINFO_HTTP_CONNECTCODE:
-      case CURLINFO_FILETIME:
-      case CURLINFO_REDIRECT_COUNT:
-      case CURLINFO_HEADER_SIZE:
-      case CURLINFO_REQUEST_SIZE:
-      case CURLINFO_SSL_VERIFYRESULT:
-      case CURLINFO_HTTPAUTH_AVAIL:
-      case CURLINFO_PROXYAUTH_AVAIL:
-      case CURLINFO_OS_ERRNO:
-      case CURLINFO_NUM_CONNECTS:
-	status = curl_easy_getinfo (ez->handle, info, &lvar);
-	if (status == CURLE_OK)
-	  (void) SLang_push_long (lvar);
-	break;
-
-      case CURLINFO_TOTAL_TIME:
-      case CURLINFO_NAMELOOKUP_TIME:
-      case CURLINFO_CONNECT_TIME:
-      case CURLINFO_PRETRANSFER_TIME:
-      case CURLINFO_STARTTRANSFER_TIME:
-      case CURLINFO_REDIRECT_TIME:
-#ifdef HAVE_CURLINFO_SIZE_UPLOAD_T
-      case CURLINFO_SIZE_UPLOAD_T:
-#else
-      case CURLINFO_SIZE_UPLOAD:
-#endif
-#ifdef HAVE_CURLINFO_SIZE_DOWNLOAD_T
-      case CURLINFO_SIZE_DOWNLOAD_T:
-#else
-      case CURLINFO_SIZE_DOWNLOAD:
-#endif
-#ifdef HAVE_CURLINFO_SPEED_DOWNLOAD_T
-      case CURLINFO_SPEED_DOWNLOAD_T:
-#else
-      case CURLINFO_SPEED_DOWNLOAD:
-#endif
-#ifdef HAVE_CURLINFO_SPEED_UPLOAD_T
-      case CURLINFO_SPEED_UPLOAD_T:
-#else
-      case CURLINFO_SPEED_UPLOAD:
-#endif
-#ifdef HAVE_CURLINFO_CONTENT_LENGTH_DOWNLOAD_T
-      case CURLINFO_CONTENT_LENGTH_DOWNLOAD_T:
-#else
-      case CURLINFO_CONTENT_LENGTH_DOWNLOAD:
-#endif
-#ifdef HAVE_CURLINFO_CONTENT_LENGTH_UPLOAD_T
-      case CURLINFO_CONTENT_LENGTH_UPLOAD_T:
-#else
-      case CURLINFO_CONTENT_LENGTH_UPLOAD:
-#endif
-	status = curl_easy_getinfo (ez->handle, info, &dvar);
-	if (status == CURLE_OK)
-	  (void) SLang_push_double (dvar);
-	break;
+	last = last->async_next;
+	n++;
+     }
+   if (list != NULL)
+     {
+	shard->head = last->async_next;
+	if (shard->head == NULL)
+	  shard->tail = NULL;
+	last->async_next = NULL;
+	__atomic_store_n (&shard->num_pending, shard->num_pending - n, __ATOMIC_RELAXED);
+     }
+   (void) pthread_mutex_unlock (&shard->mutex);
+   return list;
+}
 
-      case CURLINFO_SSL_ENGINES:
-      /* case CURLINFO_COOKIELIST: */
-	status = curl_easy_getinfo (ez->handle, info, &slist);
-	if (status == CURLE_OK)
+/* Take half of the pending transfers of the busiest other shard */
+static Easy_Type *steal_pending (Async_Shard_Type *thief, unsigned int max)
+{
+   Async_Shard_Type *victim = NULL;
+   unsigned int i, n, victim_n = 0;
+
+   for (i = 0; i < Async_Pool.num_shards; i++)
+     {
+	Async_Shard_Type *shard = Async_Pool.shards + i;
+	if (shard == thief)
+	  continue;
+	n = __atomic_load_n (&shard->num_pending, __ATOMIC_RELAXED);
+	if (n > victim_n)
 	  {
-	     (void) push_slist (slist);
-	     curl_slist_free_all (slist);
+	     victim = shard;
+	     victim_n = n;
 	  }
-	break;
-
-      case CURLINFO_PRIVATE:
-	/* used internal to this module. */
-	/* drop */
-      default:
-	SLang_verror (SL_INVALID_PARM, "Unknown or unsupported info type");
-	status = CURLE_OK;
-	break;
      }
+   if (victim == NULL)
+     return NULL;
 
-   if (status != CURLE_OK)
-     throw_curl_error (status, ez->errbuf);
+   n = (victim_n + 1)/2;
+   if (n > max) n = max;
+   return take_pending (victim, n);
+}
 
-   SLang_free_mmt (mmt);
+static void *async_shard_thread (void *arg)
+{
+   Async_Shard_Type *shard = (Async_Shard_Type *) arg;
+
+   while (0 == __atomic_load_n (&Async_Pool.stop, __ATOMIC_ACQUIRE))
+     {
+	Easy_Type *list;
+	CURLMsg *msg;
+	int running_handles, msgs_in_queue;
+	unsigned int room = ASYNC_SHARD_MAX_RUNNING - shard->num_running;
+
+	if (room)
+	  {
+	     if (NULL == (list = take_pending (shard, room)))
+	       list = steal_pending (shard, room);
+
+	     while (list != NULL)
+	       {
+		  Easy_Type *ez = list;
+		  list = ez->async_next;
+		  ez->async_next = NULL;
+		  ez->async_status = (CURLcode) curl_multi_add_handle (shard->mhandle, ez->handle);
+		  if (ez->async_status != (CURLcode) CURLM_OK)
+		    {
+		       ez->async_status = CURLE_FAILED_INIT;
+		       (void) end_transfer (ez, 0);
+		       push_async_done (shard, ez);
+		       continue;
+		    }
+		  __atomic_store_n (&shard->num_running, shard->num_running + 1, __ATOMIC_RELAXED);
+	       }
+	  }
+
+	(void) curl_multi_perform (shard->mhandle, &running_handles);
+
+	while (NULL != (msg = curl_multi_info_read (shard->mhandle, &msgs_in_queue)))
+	  {
+	     Easy_Type *ez;
+
+	     if (msg->msg != CURLMSG_DONE)
+	       continue;
+	     if ((CURLE_OK != curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (char **)&ez))
+		 || (ez == NULL))
+	       continue;
+
+	     ez->async_status = msg->data.result;
+	     (void) curl_multi_remove_handle (shard->mhandle, ez->handle);
+	     /* With native sinks, end_transfer does not execute S-Lang code */
+	     if ((-1 == end_transfer (ez, ez->async_status == CURLE_OK))
+		 && (ez->async_status == CURLE_OK))
+	       ez->async_status = CURLE_WRITE_ERROR;
+	     __atomic_store_n (&shard->num_running, shard->num_running - 1, __ATOMIC_RELAXED);
+	     push_async_done (shard, ez);
+	  }
+
+	/* curl_multi_wakeup is used to signal new work, or to stop */
+	(void) curl_multi_poll (shard->mhandle, NULL, 0, 1000, NULL);
+     }
+   return NULL;
 }
 
-/*}}}*/
+static void async_share_lock (CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+   (void) handle; (void) access; (void) userptr;
+   (void) pthread_mutex_lock (&Async_Pool.share_locks[data]);
+}
 
-/*{{{ Multi_Type Functions */
+static void async_share_unlock (CURL *handle, curl_lock_data data, void *userptr)
+{
+   (void) handle; (void) userptr;
+   (void) pthread_mutex_unlock (&Async_Pool.share_locks[data]);
+}
 
-static void throw_multi_error (CURLMcode err)
+static unsigned int get_default_num_shards (void)
 {
-   SLang_verror (Curl_Error, "%s", curl_multi_strerror(err));
+   long n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+   n = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+   if (n < 1) n = 1;
+   if (n > ASYNC_MAX_SHARDS) n = ASYNC_MAX_SHARDS;
+   return (unsigned int) n;
 }
 
-static SLang_MMT_Type *pop_multi_type (Multi_Type **mp, unsigned int flags)
+/* This stops the shard threads and releases the pool.  It is also used to
+ * clean up after a failed initialization.  Transfers that have not been
+ * collected are abandoned.
+ */
+static void free_async_pool (void)
 {
-   SLang_MMT_Type *mmt;
-   Multi_Type *m;
-   Easy_Type *ez;
+   unsigned int i;
 
-   *mp = NULL;
-   if (NULL == (mmt = SLang_pop_mmt (Multi_Type_Id)))
-     return NULL;
+   __atomic_store_n (&Async_Pool.stop, 1, __ATOMIC_RELEASE);
+   for (i = 0; i < Async_Pool.num_shards; i++)
+     (void) curl_multi_wakeup (Async_Pool.shards[i].mhandle);
+   for (i = 0; i < Async_Pool.num_shards; i++)
+     (void) pthread_join (Async_Pool.shards[i].thread, NULL);
 
-   m = (Multi_Type *)SLang_object_from_mmt (mmt);
-   if (m->mhandle == NULL)
+   for (i = 0; i < Async_Pool.max_shards; i++)
      {
-	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type object has already been closed");
-	SLang_free_mmt (mmt);
-	return NULL;
+	Async_Shard_Type *shard = Async_Pool.shards + i;
+	if (shard->mhandle != NULL)
+	  (void) curl_multi_cleanup (shard->mhandle);
+	(void) pthread_mutex_destroy (&shard->mutex);
      }
+   if (Async_Pool.shards != NULL)
+     SLfree ((char *) Async_Pool.shards);
 
-   if (m->flags & flags)
-     {
-	SLang_free_mmt (mmt);
-	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type is in an invalid state for this operation");
-	return NULL;
-     }
+   if (Async_Pool.shandle != NULL)
+     (void) curl_share_cleanup (Async_Pool.shandle);
+   for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+     (void) pthread_mutex_destroy (&Async_Pool.share_locks[i]);
 
-   ez = m->ez;
-   while (ez != NULL)
+   for (i = 0; i < 2; i++)
      {
-	if (-1 == check_handle (ez, flags))
-	  {
-	     SLang_free_mmt (mmt);
-	     return NULL;
-	  }
-	ez = ez->next;
+	if (Async_Pool.wakeup_fds[i] != -1)
+	  (void) close (Async_Pool.wakeup_fds[i]);
      }
-   *mp = m;
-   return mmt;
+
+   memset ((char *) &Async_Pool, 0, sizeof (Async_Pool_Type));
 }
 
-static int multi_remove_handle_internal (Multi_Type *m, Easy_Type *ez)
+static int init_async_pool (unsigned int num_shards)
 {
-   CURLMcode status;
+   Async_Shard_Type *shards;
+   unsigned int i;
 
-   status = curl_multi_remove_handle (m->mhandle, ez->handle);
-   ez->multi = NULL;
-   ez->next = NULL;
-   SLang_free_mmt (ez->mmt);		       /* free from multi */
-   m->length -= 1;
+   if (Async_Pool.initialized)
+     return 0;
 
-   if (status != CURLM_OK)
+   memset ((char *) &Async_Pool, 0, sizeof (Async_Pool_Type));
+   for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+     (void) pthread_mutex_init (&Async_Pool.share_locks[i], NULL);
+
+   if (-1 == pipe (Async_Pool.wakeup_fds))
      {
-	throw_multi_error (status);
-	return -1;
+	SLang_verror (Curl_Error, "pipe failed: %s", strerror (errno));
+	Async_Pool.wakeup_fds[0] = Async_Pool.wakeup_fds[1] = -1;
+	goto return_error;
+     }
+   for (i = 0; i < 2; i++)
+     {
+	int fd = Async_Pool.wakeup_fds[i];
+	(void) fcntl (fd, F_SETFL, O_NONBLOCK | fcntl (fd, F_GETFL));
+	(void) fcntl (fd, F_SETFD, FD_CLOEXEC);
+     }
+
+   if (NULL != (Async_Pool.shandle = curl_share_init ()))
+     {
+	(void) curl_share_setopt (Async_Pool.shandle, CURLSHOPT_LOCKFUNC, async_share_lock);
+	(void) curl_share_setopt (Async_Pool.shandle, CURLSHOPT_UNLOCKFUNC, async_share_unlock);
+	(void) curl_share_setopt (Async_Pool.shandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	(void) curl_share_setopt (Async_Pool.shandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+     }
+
+   /* The shards run until deinit_curl_module stops them */
+   if (NULL == (shards = (Async_Shard_Type *) SLcalloc (num_shards, sizeof (Async_Shard_Type))))
+     goto return_error;
+
+   Async_Pool.shards = shards;
+   Async_Pool.max_shards = num_shards;
+   for (i = 0; i < num_shards; i++)
+     (void) pthread_mutex_init (&shards[i].mutex, NULL);
+
+   for (i = 0; i < num_shards; i++)
+     {
+	Async_Shard_Type *shard = shards + i;
+
+	if (NULL == (shard->mhandle = curl_multi_init ()))
+	  break;
+
+	if (0 != pthread_create (&shard->thread, NULL, async_shard_thread, (void *) shard))
+	  break;
+	/* Make it visible to the other shards before they may steal from it */
+	__atomic_store_n (&Async_Pool.num_shards, i + 1, __ATOMIC_RELEASE);
      }
+
+   if (Async_Pool.num_shards == 0)
+     {
+	SLang_verror (Curl_Error, "Unable to create a thread for curl_perform_async");
+	goto return_error;
+     }
+   Async_Pool.initialized = 1;
    return 0;
+
+   return_error:
+   free_async_pool ();
+   return -1;
 }
 
-static void multi_close_internal (Multi_Type *m)
+/* Undo the options that perform_async_intrin sets for the shards */
+static void restore_async_options (Easy_Type *ez)
 {
-   Easy_Type *ez;
+   (void) curl_easy_setopt (ez->handle, CURLOPT_NOSIGNAL, ez->nosignal);
+   if (ez->share_mmt == NULL)
+     (void) curl_easy_setopt (ez->handle, CURLOPT_SHARE, NULL);
+}
 
-   ez = m->ez;
-   while (ez != NULL)
+static void submit_async (Easy_Type *ez)
+{
+   Async_Shard_Type *shard = Async_Pool.shards;
+   unsigned int i, load = get_shard_load (shard);
+
+   for (i = 1; i < Async_Pool.num_shards; i++)
      {
-	Easy_Type *next = ez->next;
-	(void) multi_remove_handle_internal (m, ez);
-	ez = next;
+	unsigned int l = get_shard_load (Async_Pool.shards + i);
+	if (l < load)
+	  {
+	     shard = Async_Pool.shards + i;
+	     load = l;
+	  }
      }
-   m->ez = NULL;
-   if (m->mhandle != NULL)
-     (void) curl_multi_cleanup (m->mhandle);
-   m->mhandle = NULL;
+
+   ez->async_next = NULL;
+   (void) pthread_mutex_lock (&shard->mutex);
+   if (shard->tail == NULL)
+     shard->head = ez;
+   else
+     shard->tail->async_next = ez;
+   shard->tail = ez;
+   __atomic_store_n (&shard->num_pending, shard->num_pending + 1, __ATOMIC_RELAXED);
+   (void) pthread_mutex_unlock (&shard->mutex);
+
+   (void) curl_multi_wakeup (shard->mhandle);
 }
 
-static void free_multi_type (Multi_Type *m)
+/* slang: curl_async_init ([Int_Type num_shards]) */
+static void async_init_intrin (void)
 {
-   if (m == NULL)
+   int num_shards = (int) get_default_num_shards ();
+
+   if ((SLang_Num_Function_Args == 1)
+       && (-1 == SLang_pop_int (&num_shards)))
      return;
 
-   multi_close_internal (m);
-   SLfree ((char *) m);
+   if (Async_Pool.initialized)
+     {
+	SLang_verror (SL_INVALID_PARM, "curl_async_init has already been called");
+	return;
+     }
+   if (num_shards < 1)
+     num_shards = 1;
+   if (num_shards > ASYNC_MAX_SHARDS)
+     num_shards = ASYNC_MAX_SHARDS;
+
+   (void) init_async_pool ((unsigned int) num_shards);
 }
 
-static void multi_remove_handle (void)
+/* slang: curl_perform_async (Curl_Type c) */
+static void perform_async_intrin (void)
 {
-   Easy_Type *ez, *prev;
-   SLang_MMT_Type *ez_mmt, *m_mmt;
-   Multi_Type *m;
+   SLang_MMT_Type *mmt;
+   Easy_Type *ez;
+   CURLcode status;
 
-   if (NULL == (ez_mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
+   if (NULL == (mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
      return;
-   if (NULL == (m_mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+
+   if (ez->multi != NULL)
      {
-	SLang_free_mmt (ez_mmt);
-	return;
+	SLang_verror (SL_INVALID_PARM, "Curl_Type is attached to a Curl_Multi_Type object");
+	goto free_return;
      }
-   prev = m->ez;
-   if (prev == ez)
-     m->ez = ez->next;
-   else
+
+   if ((ez->write_callback != NULL) || (ez->writeheader_callback != NULL)
+       || (ez->read_callback != NULL) || (ez->progress_callback != NULL)
+       || (ez->framer.type != CURL_FRAME_NONE))
      {
-	while (1)
-	  {
-	     if (prev->next == NULL)
-	       goto free_return;
-	     if (prev->next == ez)
-	       break;
-	     prev = prev->next;
-	  }
-	prev->next = ez->next;
+	SLang_verror (SL_INVALID_PARM, "curl_perform_async does not support S-Lang callbacks; use CURL_SINK_BUFFER or CURL_SINK_FILE");
+	goto free_return;
      }
 
-   (void) multi_remove_handle_internal (m, ez);
+   if (-1 == init_async_pool (get_default_num_shards ()))
+     goto free_return;
 
-   /* drop */
+   /* The sinks of a shard may not use the S-Lang allocator */
+   set_byte_buffer_native (&ez->body, 1);
+   set_byte_buffer_native (&ez->file_sink.stage, 1);
 
-   free_return:
-   SLang_free_mmt (ez_mmt);
-   SLang_free_mmt (m_mmt);
-}
+   /* Signals may not be used for timeouts in a thread.  This and the
+    * share are undone when the transfer is collected.
+    */
+   if (CURLE_OK != (status = curl_easy_setopt (ez->handle, CURLOPT_NOSIGNAL, 1L)))
+     {
+	throw_curl_error (status, ez->errbuf);
+	goto free_return;
+     }
+   if ((ez->share_mmt == NULL) && (Async_Pool.shandle != NULL))
+     (void) curl_easy_setopt (ez->handle, CURLOPT_SHARE, Async_Pool.shandle);
 
-static void multi_close (void)
-{
-   SLang_MMT_Type *mmt;
-   Multi_Type *m;
+   if (-1 == start_transfer (ez))
+     {
+	restore_async_options (ez);
+	goto free_return;
+     }
 
-   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
-     return;
+   ez->flags |= (PERFORM_RUNNING|ASYNC_RUNNING);
+   submit_async (ez);
 
-   multi_close_internal (m);
+   /* The reference is kept until the transfer has been collected */
+   Async_Pool.num_outstanding++;
+   return;
+
+   free_return:
    SLang_free_mmt (mmt);
 }
 
-static void multi_add_handle (void)
+/* Pushes (handles, status) arrays for the completed transfers */
+static void push_async_done_list (Easy_Type *list)
 {
+   SLang_Array_Type *at_handles, *at_status;
+   SLindex_Type i, num = 0;
    Easy_Type *ez;
-   SLang_MMT_Type *ez_mmt, *m_mmt;
-   Multi_Type *m;
-   CURLMcode status;
 
-   if (NULL == (ez_mmt = pop_easy_type (&ez, PERFORM_RUNNING)))
-     return;
-   if (NULL == (m_mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+   for (ez = list; ez != NULL; ez = ez->async_next)
      {
-	SLang_free_mmt (ez_mmt);
-	return;
+	ez->flags &= ~(PERFORM_RUNNING|ASYNC_RUNNING);
+	restore_async_options (ez);
+	Async_Pool.num_outstanding--;
+	num++;
      }
-   if (ez->multi != NULL)
+
+   at_handles = SLang_create_array (Easy_Type_Id, 0, NULL, &num, 1);
+   at_status = SLang_create_array (SLANG_INT_TYPE, 0, NULL, &num, 1);
+
+   /* The arrays take over the references */
+   for (i = 0, ez = list; ez != NULL; i++)
      {
-	SLang_verror (SL_INVALID_PARM, "Curl_Type is already attached to a Curl_Multi_Type object");
-	SLang_free_mmt (ez_mmt);
-	SLang_free_mmt (m_mmt);
-	return;
+	Easy_Type *next = ez->async_next;
+	ez->async_next = NULL;
+	if ((at_handles == NULL) || (at_status == NULL))
+	  SLang_free_mmt (ez->mmt);
+	else
+	  {
+	     ((SLang_MMT_Type **) at_handles->data)[i] = ez->mmt;
+	     ((int *) at_status->data)[i] = (int) ez->async_status;
+	  }
+	ez = next;
      }
 
-   status = curl_multi_add_handle (m->mhandle, ez->handle);
-   if (status != CURLM_OK)
+   if ((at_handles == NULL) || (at_status == NULL))
      {
-	throw_multi_error (status);
-	SLang_free_mmt (ez_mmt);
-	SLang_free_mmt (m_mmt);
+	if (at_handles != NULL) SLang_free_array (at_handles);
+	if (at_status != NULL) SLang_free_array (at_status);
 	return;
      }
+   (void) SLang_push_array (at_handles, 1);
+   (void) SLang_push_array (at_status, 1);
+}
 
-   ez->multi = m;
-   ez->next = m->ez;
-   m->ez = ez;
-   m->length += 1;
+/* slang: (handles, status) = curl_async_poll () */
+static void async_poll_intrin (void)
+{
+   Easy_Type *list = NULL;
 
-   /* The ez_mmt is not freed because it is now reference my the multi_type */
-   SLang_free_mmt (m_mmt);
+   if (Async_Pool.initialized)
+     list = take_async_done ();
+   push_async_done_list (list);
 }
 
-static int do_select_on_multi (Multi_Type *m, double dt)
+/* slang: (handles, status) = curl_async_wait ([Double_Type timeout]) */
+static void async_wait_intrin (void)
 {
-   struct timeval tv;
-   fd_set read_fds, write_fds, execpt_fds;
-   int max_fd;
-   CURLMcode status;
-   int ret;
+   Easy_Type *list = NULL;
+   double timeout = -1.0, deadline = 0.0;
 
-   /* Avoid a ridiculous wait period, 30 days ought to be enough */
-   if (dt > 30*86400)
-     dt = 30*86400;
+   if ((SLang_Num_Function_Args == 1)
+       && (-1 == SLang_pop_double (&timeout)))
+     return;
+
+   if (timeout >= 0.0)
+     deadline = get_monotonic_time () + timeout;
+
+   while ((Async_Pool.num_outstanding != 0)
+	  && (NULL == (list = take_async_done ())))
+     {
+	struct pollfd pfd;
+	int ms = -1;
+
+	if (timeout >= 0.0)
+	  {
+	     double dt = deadline - get_monotonic_time ();
+	     if (dt <= 0.0)
+	       break;
+	     ms = (int) (dt * 1000.0 + 0.999);
+	  }
+
+	pfd.fd = Async_Pool.wakeup_fds[0];
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if ((-1 == poll (&pfd, 1, ms))
+	    && (errno == EINTR)
+	    && (0 != SLang_handle_interrupt ()))
+	  return;
+     }
+   push_async_done_list (list);
+}
+#else
+static void async_init_intrin (void)
+{
+   SLang_verror (SL_NotImplemented_Error, "curl_async_init requires POSIX threads and libcurl 7.68.0 or newer");
+}
+static void perform_async_intrin (void)
+{
+   SLang_verror (SL_NotImplemented_Error, "curl_perform_async requires POSIX threads and libcurl 7.68.0 or newer");
+}
+static void async_poll_intrin (void)
+{
+   SLang_verror (SL_NotImplemented_Error, "curl_async_poll requires POSIX threads and libcurl 7.68.0 or newer");
+}
+static void async_wait_intrin (void)
+{
+   SLang_verror (SL_NotImplemented_Error, "curl_async_wait requires POSIX threads and libcurl 7.68.0 or newer");
+}
+#endif				       /* HAVE_ASYNC */
+
+/*}}}*/
+
+/*{{{ Share_Type Functions */
+
+#ifdef HAVE_CURLOPT_SHARE
+static void free_share_type (Share_Type *sh)
+{
+   if (sh == NULL)
+     return;
+
+   if (sh->shandle != NULL)
+     (void) curl_share_cleanup (sh->shandle);
+# ifdef HAVE_ASYNC
+     {
+	int i;
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+	  (void) pthread_mutex_destroy (&sh->locks[i]);
+     }
+# endif
+   SLfree ((char *) sh);
+}
+
+# ifdef HAVE_ASYNC
+static void share_lock_function (CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+   Share_Type *sh = (Share_Type *) userptr;
+
+   (void) handle; (void) access;
+   (void) pthread_mutex_lock (&sh->locks[data]);
+}
 
-   tv.tv_sec = (unsigned long) dt;
-   tv.tv_usec = (unsigned long) ((dt - tv.tv_sec) * 1e6);
+static void share_unlock_function (CURL *handle, curl_lock_data data, void *userptr)
+{
+   Share_Type *sh = (Share_Type *) userptr;
 
-   FD_ZERO(&read_fds);
-   FD_ZERO(&write_fds);
-   FD_ZERO(&execpt_fds);
+   (void) handle;
+   (void) pthread_mutex_unlock (&sh->locks[data]);
+}
+# endif
 
-   status  = curl_multi_fdset (m->mhandle, &read_fds, &write_fds, &execpt_fds, &max_fd);
-   if (status != CURLM_OK)
+static int do_share_setopt (Share_Type *sh, int opt, long val)
+{
+   CURLSHcode status;
+
+   switch (opt)
      {
-	throw_multi_error (status);
+      case CURLSHOPT_SHARE:
+      case CURLSHOPT_UNSHARE:
+	break;
+
+      default:
+	SLang_verror (SL_INVALID_PARM, "cURL share option is unknown or unsupported");
 	return -1;
      }
 
-   ret = select (max_fd + 1, &read_fds, &write_fds, &execpt_fds, &tv);
-   if (ret == -1)
+   status = curl_share_setopt (sh->shandle, (CURLSHoption) opt, val);
+   if (status != CURLSHE_OK)
      {
-	/* Pretend like something is available to read/write  */
-	ret = 1;
+	SLang_verror (Curl_Error, "%s", curl_share_strerror (status));
+	return -1;
      }
-
-   return ret;
+   return 0;
 }
 
-static int multi_perform_intrin (void)
+/* slang: Curl_Share_Type curl_share_new ([Int_Type lock_data, ...]) */
+static void new_share_intrin (void)
 {
    SLang_MMT_Type *mmt;
-   Multi_Type *m;
-   Easy_Type *ez;
-   CURLMcode status;
-   int running_handles;
-   double dt = 0.0;
+   Share_Type *sh;
+   int nargs = SLang_Num_Function_Args;
+   int *data = NULL;
+   int i;
 
-   if (SLang_Num_Function_Args == 2)
+   if (nargs && (NULL == (data = (int *) SLmalloc (nargs * sizeof (int)))))
+     return;
+
+   for (i = nargs; i > 0; i--)
      {
-	if (-1 == SLang_pop_double (&dt))
-	  return -1;
-	if (dt < 0.0)
-	  dt = 0.0;
+	if (-1 == SLang_pop_int (&data[i-1]))
+	  {
+	     SLfree ((char *) data);
+	     return;
+	  }
      }
 
-   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
-     return -1;
+   if (NULL == (sh = (Share_Type *) SLcalloc (1, sizeof (Share_Type))))
+     goto free_return;
+# ifdef HAVE_ASYNC
+   for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+     (void) pthread_mutex_init (&sh->locks[i], NULL);
+# endif
 
-   ez = m->ez;
-   if (ez == NULL)
+   if (NULL == (sh->shandle = curl_share_init ()))
      {
-	SLang_verror (SL_INVALID_PARM, "The Curl_Multi_Type object has no handles");
-	SLang_free_mmt (mmt);
-	return -1;
+	SLang_verror (Curl_Error, "curl_share_init failed");
+	free_share_type (sh);
+	goto free_return;
      }
+# ifdef HAVE_ASYNC
+   (void) curl_share_setopt (sh->shandle, CURLSHOPT_LOCKFUNC, share_lock_function);
+   (void) curl_share_setopt (sh->shandle, CURLSHOPT_UNLOCKFUNC, share_unlock_function);
+   (void) curl_share_setopt (sh->shandle, CURLSHOPT_USERDATA, (void *) sh);
+# endif
 
-   while (ez != NULL)
+   for (i = 0; i < nargs; i++)
      {
-	ez->flags |= PERFORM_RUNNING;
-	ez = ez->next;
+	if (-1 == do_share_setopt (sh, CURLSHOPT_SHARE, (long) data[i]))
+	  {
+	     free_share_type (sh);
+	     goto free_return;
+	  }
      }
 
-   running_handles = 0;
-   if (dt > 0.0)
+   if (NULL == (mmt = SLang_create_mmt (Share_Type_Id, (VOID_STAR) sh)))
      {
-	int ret = do_select_on_multi (m, dt);
-	if (ret == -1)
-	  running_handles = -1;
+	free_share_type (sh);
+	goto free_return;
      }
 
-   if (running_handles == 0) while (1)
-     {
-	status = curl_multi_perform (m->mhandle, &running_handles);
-	if (status == CURLM_CALL_MULTI_PERFORM)
-	  {
-	     if (0 != SLang_handle_interrupt ())
-	       break;
-
-	     continue;
-	  }
+   if (-1 == SLang_push_mmt (mmt))
+     SLang_free_mmt (mmt);
 
-	if (status == CURLM_OK)
-	  break;
+   free_return:
+   if (data != NULL)
+     SLfree ((char *) data);
+}
 
-	throw_multi_error (status);
-	break;
-     }
+/* slang: curl_share_setopt (Curl_Share_Type s, Int_Type option, Int_Type lock_data) */
+static void share_setopt_intrin (int *optp, int *valp)
+{
+   SLang_MMT_Type *mmt;
+   Share_Type *sh;
 
-   ez = m->ez;
-   while (ez != NULL)
-     {
-	ez->flags &= ~PERFORM_RUNNING;
-	ez = ez->next;
-     }
+   if (NULL == (mmt = SLang_pop_mmt (Share_Type_Id)))
+     return;
+   sh = (Share_Type *) SLang_object_from_mmt (mmt);
 
+   (void) do_share_setopt (sh, *optp, (long) *valp);
    SLang_free_mmt (mmt);
-   return running_handles;
 }
+#endif
 
-static void multi_info_read (void)
+/*}}}*/
+
+/*{{{ Mime_Type Functions */
+
+#ifdef HAVE_CURLOPT_MIMEPOST
+static void free_mime_type (Mime_Type *mt)
 {
-   SLang_MMT_Type *mmt;
-   Multi_Type *m;
-   CURLMsg *msg;
-   int msgs_in_queue;
-   SLang_Ref_Type *ref = NULL;
+   if (mt == NULL)
+     return;
 
-   if (SLang_Num_Function_Args == 2)
+   if (mt->mime != NULL)
+     curl_mime_free (mt->mime);
+   SLfree ((char *) mt);
+}
+
+/* slang: Curl_Mime_Type curl_mime_new (Curl_Type c) */
+static void new_mime_intrin (void)
+{
+   SLang_MMT_Type *ez_mmt, *mmt;
+   Easy_Type *ez;
+   Mime_Type *mt;
+
+   if (NULL == (ez_mmt = pop_easy_type (&ez, 0)))
+     return;
+
+   if (NULL == (mt = (Mime_Type *) SLcalloc (1, sizeof (Mime_Type))))
      {
-	if (-1 == SLang_pop_ref (&ref))
-	  return;
+	SLang_free_mmt (ez_mmt);
+	return;
      }
+   mt->handle = ez->handle;
+   SLang_free_mmt (ez_mmt);
 
-   if (NULL == (mmt = pop_multi_type (&m, PERFORM_RUNNING)))
+   if (NULL == (mt->mime = curl_mime_init (mt->handle)))
      {
-	SLang_free_ref (ref);
+	SLang_verror (Curl_Error, "curl_mime_init failed");
+	free_mime_type (mt);
 	return;
      }
 
-   while (NULL != (msg = curl_multi_info_read (m->mhandle, &msgs_in_queue)))
+   if (NULL == (mmt = SLang_create_mmt (Mime_Type_Id, (VOID_STAR) mt)))
      {
-	CURLcode status;
-	Easy_Type *ez;
+	free_mime_type (mt);
+	return;
+     }
 
-	if (msg->msg != CURLMSG_DONE)
-	  continue;
+   if (-1 == SLang_push_mmt (mmt))
+     SLang_free_mmt (mmt);
+}
 
-	/* The Easy_Type object was set in the new_curl_intrin function */
-	status = curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (char **)&ez);
-	if ((status != CURLE_OK) || (ez == NULL))
-	  {
-	     throw_curl_error (status, "Internal cURL error");
-	     break;
-	  }
+/* Pops the optional (type [,filename]) arguments of the addpart functions
+ * and applies them to the part.
+ */
+static int pop_mime_part_attributes (curl_mimepart *part, int nargs)
+{
+   char *type = NULL, *filename = NULL;
+   CURLcode status = CURLE_OK;
 
-	if (ref != NULL)
-	  {
-	     int i = (int) msg->data.result;
-	     if (-1 == SLang_assign_to_ref (ref, SLANG_INT_TYPE, (VOID_STAR)&i))
-	       break;
-	  }
-	(void) SLang_push_mmt (ez->mmt);
-	goto free_return;
+   if ((nargs == 2) && (-1 == SLang_pop_slstring (&filename)))
+     return -1;
+
+   if ((nargs >= 1) && (-1 == SLang_pop_slstring (&type)))
+     {
+	if (filename != NULL) SLang_free_slstring (filename);
+	return -1;
      }
 
-   (void) SLang_push_null ();
+   if (type != NULL)
+     status = curl_mime_type (part, type);
+   if ((status == CURLE_OK) && (filename != NULL))
+     status = curl_mime_filename (part, filename);
 
-   free_return:
+   if (type != NULL) SLang_free_slstring (type);
+   if (filename != NULL) SLang_free_slstring (filename);
 
-   if (ref != NULL)
-     SLang_free_ref (ref);
-   SLang_free_mmt (mmt);
+   if (status != CURLE_OK)
+     {
+	SLang_verror (Curl_Error, "%s", curl_easy_strerror (status));
+	return -1;
+     }
+   return 0;
 }
 
-static void new_multi_intrin (void)
+/* slang: curl_mime_addpart (Curl_Mime_Type m, String_Type name,
+ *                           String_Type|BString_Type data [,type [,filename]]);
+ * slang: curl_mime_addfile (Curl_Mime_Type m, String_Type name,
+ *                           String_Type path [,type [,filename]]);
+ *
+ * The contents of a file part are read by libcurl during the transfer.
+ */
+static void mime_add_part (int is_file)
 {
    SLang_MMT_Type *mmt;
-   Multi_Type *m;
+   Mime_Type *mt;
+   curl_mimepart *part;
+   SLang_BString_Type *bstr = NULL;
+   char *name = NULL, *path = NULL;
+   int nargs = SLang_Num_Function_Args - 3;
+   CURLcode status;
 
-   if (NULL == (m = (Multi_Type *) SLcalloc (1, sizeof (Multi_Type))))
+   if ((nargs < 0) || (nargs > 2))
+     {
+	SLang_verror (SL_USAGE_ERROR, "Usage: %s (Curl_Mime_Type, name, %s [,type [,filename]])",
+		      is_file ? "curl_mime_addfile" : "curl_mime_addpart",
+		      is_file ? "path" : "data");
+	return;
+     }
+
+   if (-1 == SLreverse_stack (nargs + 3))
      return;
 
-   if (NULL == (m->mhandle = curl_multi_init ()))
+   if (NULL == (mmt = SLang_pop_mmt (Mime_Type_Id)))
+     return;
+   mt = (Mime_Type *) SLang_object_from_mmt (mmt);
+
+   if (-1 == SLang_pop_slstring (&name))
+     goto free_return;
+
+   if (is_file)
      {
-	SLang_verror (Curl_Error, "curl_multi_init failed");
-	free_multi_type (m);
-	return;
+	if (-1 == SLang_pop_slstring (&path))
+	  goto free_return;
      }
+   else if (-1 == SLang_pop_bstring (&bstr))   /* strings are converted */
+     goto free_return;
 
-   if (NULL == (mmt = SLang_create_mmt (Multi_Type_Id, (VOID_STAR) m)))
+   if (NULL == (part = curl_mime_addpart (mt->mime)))
      {
-	free_multi_type (m);
-	return;
+	SLang_verror (Curl_Error, "curl_mime_addpart failed");
+	goto free_return;
      }
 
-   if (-1 == SLang_push_mmt (mmt))
-     SLang_free_mmt (mmt);
-}
+   status = curl_mime_name (part, name);
+   if (status == CURLE_OK)
+     {
+	if (is_file)
+	  status = curl_mime_filedata (part, path);
+	else
+	  {
+	     SLstrlen_Type len;
+	     unsigned char *data = SLbstring_get_pointer (bstr, &len);
+	     status = curl_mime_data (part, (char *) data, (size_t) len);
+	  }
+     }
 
-static int get_multi_length_intrin (void)
-{
-   SLang_MMT_Type *mmt;
-   Multi_Type *m;
-   int len;
+   if (status != CURLE_OK)
+     {
+	SLang_verror (Curl_Error, "%s", curl_easy_strerror (status));
+	goto free_return;
+     }
 
-   if (NULL == (mmt = pop_multi_type (&m, 0)))
-     return -1;
+   /* Reverse the remaining arguments back to their original order */
+   if (nargs && (-1 == SLreverse_stack (nargs)))
+     goto free_return;
+   (void) pop_mime_part_attributes (part, nargs);
+   nargs = 0;
 
-   len = m->length;
+   free_return:
+   if (nargs) (void) SLdo_pop_n (nargs);
+   if (bstr != NULL) SLbstring_free (bstr);
+   if (path != NULL) SLang_free_slstring (path);
+   if (name != NULL) SLang_free_slstring (name);
    SLang_free_mmt (mmt);
-   return len;
 }
 
+static void mime_addpart_intrin (void)
+{
+   mime_add_part (0);
+}
+
+static void mime_addfile_intrin (void)
+{
+   mime_add_part (1);
+}
+#endif
+
 /*}}}*/
 
 static void escape_intrin (SLang_BString_Type *bstr)
@@ -1697,6 +7056,11 @@ static SLang_Intrin_Fun_Type Module_Intrinsics [] =
    MAKE_INTRINSIC_0("curl_global_cleanup", global_cleanup, SLANG_VOID_TYPE),
    MAKE_INTRINSIC_0("curl_perform", perform_intrin, SLANG_VOID_TYPE),
    MAKE_INTRINSIC_0("curl_close", close_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_reset", reset_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_async_init", async_init_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_perform_async", perform_async_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_async_poll", async_poll_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_async_wait", async_wait_intrin, SLANG_VOID_TYPE),
    MAKE_INTRINSIC_0("curl_get_info", get_info_intrin, SLANG_VOID_TYPE),
 
    MAKE_INTRINSIC_0("curl_multi_new", new_multi_intrin, SLANG_VOID_TYPE),
@@ -1705,6 +7069,13 @@ static SLang_Intrin_Fun_Type Module_Intrinsics [] =
    MAKE_INTRINSIC_0("curl_multi_add_handle", multi_add_handle, SLANG_VOID_TYPE),
    MAKE_INTRINSIC_0("curl_multi_close", multi_close, SLANG_VOID_TYPE),
    MAKE_INTRINSIC_0("curl_multi_info_read", multi_info_read, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_multi_setopt", multi_setopt_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_multi_run", multi_run_intrin, SLANG_INT_TYPE),
+   MAKE_INTRINSIC_0("curl_multi_info_read_all", multi_info_read_all, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_fetch_many", fetch_many_intrin, SLANG_VOID_TYPE),
+#ifdef HAVE_CURL_MULTI_WAKEUP
+   MAKE_INTRINSIC_0("curl_multi_wakeup", multi_wakeup_intrin, SLANG_VOID_TYPE),
+#endif
 
    MAKE_INTRINSIC_I("curl_easy_strerror", easy_strerror_intrin, SLANG_STRING_TYPE),
    MAKE_INTRINSIC_I("curl_strerror", easy_strerror_intrin, SLANG_STRING_TYPE),
@@ -1715,6 +7086,21 @@ static SLang_Intrin_Fun_Type Module_Intrinsics [] =
    /* Local Additions */
    MAKE_INTRINSIC_0("curl_get_url", get_url_intrin, SLANG_VOID_TYPE),
    MAKE_INTRINSIC_0("curl_multi_length", get_multi_length_intrin, SLANG_INT_TYPE),
+   MAKE_INTRINSIC_0("curl_get_body", get_body_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_S("curl_pool_get", pool_get_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_pool_put", pool_put_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_S("curl_get_header", get_header_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_get_headers", get_headers_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_get_digest", get_digest_intrin, SLANG_VOID_TYPE),
+#ifdef HAVE_CURLOPT_SHARE
+   MAKE_INTRINSIC_0("curl_share_new", new_share_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_II("curl_share_setopt", share_setopt_intrin, SLANG_VOID_TYPE),
+#endif
+#ifdef HAVE_CURLOPT_MIMEPOST
+   MAKE_INTRINSIC_0("curl_mime_new", new_mime_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_mime_addpart", mime_addpart_intrin, SLANG_VOID_TYPE),
+   MAKE_INTRINSIC_0("curl_mime_addfile", mime_addfile_intrin, SLANG_VOID_TYPE),
+#endif
 
    SLANG_END_INTRIN_FUN_TABLE
 };
@@ -1809,6 +7195,22 @@ static SLang_IConstant_Type Module_IConstants [] =
    MAKE_ICONSTANT("CURLOPT_COOKIESESSION", CURLOPT_COOKIESESSION),
    MAKE_ICONSTANT("CURLOPT_HTTPGET", CURLOPT_HTTPGET),
    MAKE_ICONSTANT("CURLOPT_HTTP_VERSION", CURLOPT_HTTP_VERSION),
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_NONE", CURL_HTTP_VERSION_NONE),
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_1_0", CURL_HTTP_VERSION_1_0),
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_1_1", CURL_HTTP_VERSION_1_1),
+#ifdef HAVE_CURL_HTTP_VERSION_2_0
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_2_0", CURL_HTTP_VERSION_2_0),
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_2", CURL_HTTP_VERSION_2_0),
+#endif
+#ifdef HAVE_CURL_HTTP_VERSION_2TLS
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_2TLS", CURL_HTTP_VERSION_2TLS),
+#endif
+#ifdef HAVE_CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE", CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE),
+#endif
+#ifdef HAVE_CURL_HTTP_VERSION_3
+   MAKE_ICONSTANT("CURL_HTTP_VERSION_3", CURL_HTTP_VERSION_3),
+#endif
    MAKE_ICONSTANT("CURLOPT_FTPPORT", CURLOPT_FTPPORT),
    MAKE_ICONSTANT("CURLOPT_QUOTE", CURLOPT_QUOTE),
 #ifdef HAVE_CURLOPT_POSTQUOTE
@@ -1863,6 +7265,8 @@ static SLang_IConstant_Type Module_IConstants [] =
    MAKE_ICONSTANT("CURLOPT_LOW_SPEED_LIMIT", CURLOPT_LOW_SPEED_LIMIT),
    MAKE_ICONSTANT("CURLOPT_LOW_SPEED_TIME", CURLOPT_LOW_SPEED_TIME),
    MAKE_ICONSTANT("CURLOPT_MAXCONNECTS", CURLOPT_MAXCONNECTS),
+   MAKE_ICONSTANT("CURLOPT_MAX_RECV_SPEED_LARGE", CURLOPT_MAX_RECV_SPEED_LARGE),
+   MAKE_ICONSTANT("CURLOPT_MAX_SEND_SPEED_LARGE", CURLOPT_MAX_SEND_SPEED_LARGE),
    MAKE_ICONSTANT("CURLOPT_CLOSEPOLICY", CURLOPT_CLOSEPOLICY),
    MAKE_ICONSTANT("CURLOPT_FORBID_REUSE", CURLOPT_FORBID_REUSE),
    MAKE_ICONSTANT("CURLOPT_CONNECTTIMEOUT", CURLOPT_CONNECTTIMEOUT),
@@ -1890,6 +7294,15 @@ static SLang_IConstant_Type Module_IConstants [] =
    MAKE_ICONSTANT("CURLOPT_KRB4LEVEL", CURLOPT_KRB4LEVEL),
    MAKE_ICONSTANT("CURLOPT_PRIVATE", CURLOPT_PRIVATE),
    MAKE_ICONSTANT("CURLOPT_TELNETOPTIONS", CURLOPT_TELNETOPTIONS),
+   MAKE_ICONSTANT("CURLOPT_WRITE_COALESCE", CURLOPT_WRITE_COALESCE),
+   MAKE_ICONSTANT("CURLOPT_HEADER_COALESCE", CURLOPT_HEADER_COALESCE),
+   MAKE_ICONSTANT("CURLOPT_WRITE_FRAMING", CURLOPT_WRITE_FRAMING),
+   MAKE_ICONSTANT("CURLOPT_WRITE_DIGEST", CURLOPT_WRITE_DIGEST),
+   MAKE_ICONSTANT("CURLOPT_READ_DIGEST", CURLOPT_READ_DIGEST),
+   MAKE_ICONSTANT("CURLOPT_QUEUE_PRIORITY", CURLOPT_QUEUE_PRIORITY),
+   MAKE_ICONSTANT("CURLOPT_RETRY_MAX", CURLOPT_RETRY_MAX),
+   MAKE_ICONSTANT("CURLOPT_RETRY_BACKOFF", CURLOPT_RETRY_BACKOFF),
+   MAKE_ICONSTANT("CURLOPT_RETRY_JITTER", CURLOPT_RETRY_JITTER),
 
 #ifdef HAVE_CURLOPT_USE_SSL
    MAKE_ICONSTANT("CURLUSESSL_NONE", CURLUSESSL_NONE),
@@ -1898,6 +7311,54 @@ static SLang_IConstant_Type Module_IConstants [] =
    MAKE_ICONSTANT("CURLUSESSL_ALL", CURLUSESSL_ALL),
 #endif
 
+   MAKE_ICONSTANT("CURL_SINK_BUFFER", CURL_SINK_BUFFER),
+   MAKE_ICONSTANT("CURL_SINK_FILE", CURL_SINK_FILE),
+   MAKE_ICONSTANT("CURL_FRAME_NONE", CURL_FRAME_NONE),
+   MAKE_ICONSTANT("CURL_FRAME_LINES", CURL_FRAME_LINES),
+   MAKE_ICONSTANT("CURL_FRAME_SSE", CURL_FRAME_SSE),
+   MAKE_ICONSTANT("CURL_FRAME_LENGTH32", CURL_FRAME_LENGTH32),
+   MAKE_ICONSTANT("CURL_DIGEST_NONE", CURL_DIGEST_NONE),
+   MAKE_ICONSTANT("CURL_DIGEST_CRC32C", CURL_DIGEST_CRC32C),
+   MAKE_ICONSTANT("CURL_DIGEST_SHA256", CURL_DIGEST_SHA256),
+
+#ifdef HAVE_CURLMOPT_PIPELINING
+   MAKE_ICONSTANT("CURLMOPT_PIPELINING", CURLMOPT_PIPELINING),
+   MAKE_ICONSTANT("CURLPIPE_NOTHING", 0),
+   MAKE_ICONSTANT("CURLPIPE_HTTP1", 1),
+#endif
+#ifdef HAVE_CURLPIPE_MULTIPLEX
+   MAKE_ICONSTANT("CURLPIPE_MULTIPLEX", CURLPIPE_MULTIPLEX),
+#endif
+#ifdef HAVE_CURLMOPT_MAXCONNECTS
+   MAKE_ICONSTANT("CURLMOPT_MAXCONNECTS", CURLMOPT_MAXCONNECTS),
+#endif
+#ifdef HAVE_CURLMOPT_MAX_HOST_CONNECTIONS
+   MAKE_ICONSTANT("CURLMOPT_MAX_HOST_CONNECTIONS", CURLMOPT_MAX_HOST_CONNECTIONS),
+#endif
+#ifdef HAVE_CURLMOPT_MAX_TOTAL_CONNECTIONS
+   MAKE_ICONSTANT("CURLMOPT_MAX_TOTAL_CONNECTIONS", CURLMOPT_MAX_TOTAL_CONNECTIONS),
+#endif
+#ifdef HAVE_CURLMOPT_MAX_CONCURRENT_STREAMS
+   MAKE_ICONSTANT("CURLMOPT_MAX_CONCURRENT_STREAMS", CURLMOPT_MAX_CONCURRENT_STREAMS),
+#endif
+   MAKE_ICONSTANT("CURLMOPT_MAX_RUNNING", CURLMOPT_MAX_RUNNING),
+   MAKE_ICONSTANT("CURLMOPT_HOST_WEIGHT", CURLMOPT_HOST_WEIGHT),
+   MAKE_ICONSTANT("CURLMOPT_MAX_REQUEST_RATE", CURLMOPT_MAX_REQUEST_RATE),
+   MAKE_ICONSTANT("CURLMOPT_MAX_BYTE_RATE", CURLMOPT_MAX_BYTE_RATE),
+   MAKE_ICONSTANT("CURLMOPT_MAX_HOST_REQUEST_RATE", CURLMOPT_MAX_HOST_REQUEST_RATE),
+   MAKE_ICONSTANT("CURLMOPT_MAX_HOST_BYTE_RATE", CURLMOPT_MAX_HOST_BYTE_RATE),
+
+#ifdef HAVE_CURLOPT_SHARE
+   MAKE_ICONSTANT("CURLSHOPT_SHARE", CURLSHOPT_SHARE),
+   MAKE_ICONSTANT("CURLSHOPT_UNSHARE", CURLSHOPT_UNSHARE),
+   MAKE_ICONSTANT("CURL_LOCK_DATA_COOKIE", CURL_LOCK_DATA_COOKIE),
+   MAKE_ICONSTANT("CURL_LOCK_DATA_DNS", CURL_LOCK_DATA_DNS),
+   MAKE_ICONSTANT("CURL_LOCK_DATA_SSL_SESSION", CURL_LOCK_DATA_SSL_SESSION),
+#endif
+#ifdef HAVE_CURL_LOCK_DATA_CONNECT
+   MAKE_ICONSTANT("CURL_LOCK_DATA_CONNECT", CURL_LOCK_DATA_CONNECT),
+#endif
+
    MAKE_ICONSTANT("CURL_GLOBAL_ALL", CURL_GLOBAL_ALL),
    MAKE_ICONSTANT("CURL_GLOBAL_SSL", CURL_GLOBAL_SSL),
    MAKE_ICONSTANT("CURL_GLOBAL_WIN32", CURL_GLOBAL_WIN32),
@@ -1951,6 +7412,9 @@ static SLang_IConstant_Type Module_IConstants [] =
    MAKE_ICONSTANT("CURLINFO_PROXYAUTH_AVAIL", CURLINFO_PROXYAUTH_AVAIL),
    MAKE_ICONSTANT("CURLINFO_OS_ERRNO", CURLINFO_OS_ERRNO),
    MAKE_ICONSTANT("CURLINFO_NUM_CONNECTS", CURLINFO_NUM_CONNECTS),
+#ifdef HAVE_CURLINFO_HTTP_VERSION
+   MAKE_ICONSTANT("CURLINFO_HTTP_VERSION", CURLINFO_HTTP_VERSION),
+#endif
    MAKE_ICONSTANT("CURLINFO_SSL_ENGINES", CURLINFO_SSL_ENGINES),
 
    MAKE_ICONSTANT("CURLE_OK", CURLE_OK),
@@ -2047,6 +7511,22 @@ static void destroy_multi_type (SLtype type, VOID_STAR f)
    free_multi_type (m);
 }
 
+#ifdef HAVE_CURLOPT_SHARE
+static void destroy_share_type (SLtype type, VOID_STAR f)
+{
+   (void) type;
+   free_share_type ((Share_Type *) f);
+}
+#endif
+
+#ifdef HAVE_CURLOPT_MIMEPOST
+static void destroy_mime_type (SLtype type, VOID_STAR f)
+{
+   (void) type;
+   free_mime_type ((Mime_Type *) f);
+}
+#endif
+
 #if SLANG_VERSION >= 20005
 static int multi_length_method (SLtype type, VOID_STAR v, SLuindex_Type *len)
 {
@@ -2095,6 +7575,38 @@ static int register_types (void)
 	Multi_Type_Id = SLclass_get_class_id (cl);
      }
 
+#ifdef HAVE_CURLOPT_SHARE
+   if (Share_Type_Id == 0)
+     {
+	if (NULL == (cl = SLclass_allocate_class ("Curl_Share_Type")))
+	  return -1;
+
+	if (-1 == SLclass_set_destroy_function (cl, destroy_share_type))
+	  return -1;
+
+	if (-1 == SLclass_register_class (cl, SLANG_VOID_TYPE, sizeof (Share_Type), SLANG_CLASS_TYPE_MMT))
+	  return -1;
+
+	Share_Type_Id = SLclass_get_class_id (cl);
+     }
+#endif
+
+#ifdef HAVE_CURLOPT_MIMEPOST
+   if (Mime_Type_Id == 0)
+     {
+	if (NULL == (cl = SLclass_allocate_class ("Curl_Mime_Type")))
+	  return -1;
+
+	if (-1 == SLclass_set_destroy_function (cl, destroy_mime_type))
+	  return -1;
+
+	if (-1 == SLclass_register_class (cl, SLANG_VOID_TYPE, sizeof (Mime_Type), SLANG_CLASS_TYPE_MMT))
+	  return -1;
+
+	Mime_Type_Id = SLclass_get_class_id (cl);
+     }
+#endif
+
    if (Curl_Error == 0)
      {
 	if (-1 == (Curl_Error = SLerr_new_exception (SL_RunTime_Error, "CurlError", "curl error")))
@@ -2111,6 +7623,8 @@ int init_curl_module_ns (char *ns_name)
    if (-1 == register_types ())
      return -1;
 
+   read_file_sink_umask ();
+
    if (NULL == (ns = SLns_create_namespace (ns_name)))
      return -1;
 
@@ -2126,4 +7640,14 @@ int init_curl_module_ns (char *ns_name)
 /* This function is optional */
 void deinit_curl_module (void)
 {
+#ifdef HAVE_ASYNC
+   if (Async_Pool.initialized)
+     free_async_pool ();
+#endif
+   while (Handle_Pool_Num > 0)
+     {
+	Handle_Pool_Num--;
+	free_easy_type (Handle_Pool[Handle_Pool_Num]);
+	Handle_Pool[Handle_Pool_Num] = NULL;
+     }
 }